@@ -4,9 +4,307 @@
 
 #include "CAudio.h"
 #include <SDL.h>
+#include <CBuffer.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-CAudio::~CAudio() {}
+/**
+ * @brief modified bessel function of the first kind, order 0 (for the kaiser
+ * window)
+ */
+static double besselI0(double x) {
+    double sum = 1;
+    double term = 1;
+    for (int k = 1; k < 64; k++) {
+        double t = x / (2 * k);
+        term *= t * t;
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
 
-int CAudio::update() { return 0; }
+/**
+ * @brief multiply-accumulate the filter window, taps must be a multiple of 8
+ * @param a history window
+ * @param b coefficients
+ * @param n taps
+ * @return the filtered sample
+ */
+static float dotProduct(const float *a, const float *b, int n) {
+#if defined(__SSE__)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int i = 0; i < n; i += 8) {
+        acc0 = _mm_add_ps(
+            acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(
+            acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    return _mm_cvtss_f32(acc0);
+#elif defined(__ARM_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    for (int i = 0; i < n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+    float32x2_t s = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#else
+    float acc = 0;
+    for (int i = 0; i < n; i++) {
+        acc += a[i] * b[i];
+    }
+    return acc;
+#endif
+}
 
-CAudio::CAudio(CSID *sid) { _sid = sid; }
+CAudio::CAudio(CSID *sid, int clockHz, int quality, bool useDevice) {
+    _sid = sid;
+    if (!useDevice) {
+        initFilter(clockHz, quality);
+        return;
+    }
+
+    // open the device, we push samples through the queue api
+    SDL_AudioSpec want = {0};
+    SDL_AudioSpec have = {0};
+    want.freq = AUDIO_OUTPUT_HZ;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 1024;
+    _device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+    if (_device == 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_OpenAudioDevice(): %s", SDL_GetError());
+    } else {
+        _outputHz = have.freq;
+        SDL_PauseAudioDevice(_device, 0);
+    }
+
+    initFilter(clockHz, quality);
+}
+
+CAudio::~CAudio() {
+    closeFile();
+    if (_device) {
+        SDL_CloseAudioDevice(_device);
+    }
+    SAFE_FREE(_coeffs)
+    SAFE_FREE(_history)
+    SAFE_FREE(_out)
+}
+
+/**
+ * @brief build the polyphase filter bank
+ * @param clockHz input (SID) rate
+ * @param quality one of the AUDIO_QUALITY presets
+ */
+void CAudio::initFilter(int clockHz, int quality) {
+    // taps (multiple of 8, for the simd loop), phases (power of 2), kaiser beta
+    // and cutoff relative to the output nyquist
+    double beta;
+    double cutoff;
+    switch (quality) {
+    case AUDIO_QUALITY_FAST:
+        _taps = 96;
+        _phaseShift = 4;
+        beta = 5;
+        cutoff = 0.80;
+        break;
+    case AUDIO_QUALITY_HIGH:
+        _taps = 1024;
+        _phaseShift = 7;
+        beta = 9;
+        cutoff = 0.90;
+        break;
+    default:
+        _taps = 384;
+        _phaseShift = 6;
+        beta = 7;
+        cutoff = 0.85;
+        break;
+    }
+    _phases = 1 << _phaseShift;
+
+    // cutoff in cycles per input sample
+    double fc = cutoff * 0.5 * _outputHz / clockHz;
+    _coeffs = (float *)calloc(1, _phases * _taps * sizeof(float));
+    double half = _taps / 2.0;
+    double i0Beta = besselI0(beta);
+    for (int p = 0; p < _phases; p++) {
+        // phase p is the output instant falling p/_phases input samples before
+        // the newest sample in the window
+        double frac = (double)p / _phases;
+        float *c = &_coeffs[p * _taps];
+        double sum = 0;
+        for (int k = 0; k < _taps; k++) {
+            double t = k - (_taps - 1) / 2.0 + frac;
+            double x = 2 * fc * t;
+            double sinc = (t == 0) ? 1 : sin(M_PI * x) / (M_PI * x);
+            double r = t / half;
+            double w = (r <= -1 || r >= 1)
+                           ? 0
+                           : besselI0(beta * sqrt(1 - r * r)) / i0Beta;
+            c[k] = (float)(sinc * w);
+            sum += c[k];
+        }
+
+        // unity gain at dc for every phase
+        for (int k = 0; k < _taps; k++) {
+            c[k] = (float)(c[k] / sum);
+        }
+    }
+
+    _history = (float *)calloc(1, _taps * 2 * sizeof(float));
+    _step = (uint64_t)(((double)clockHz / _outputHz) * 4294967296.0);
+    _outSize =
+        (int)((uint64_t)SID_SAMPLE_BUFFER_SIZE * _outputHz / clockHz) + 1;
+    _out = (int16_t *)calloc(1, _outSize * sizeof(int16_t));
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "audio resampler: %dhz -> %dhz, taps=%d, phases=%d", clockHz,
+                _outputHz, _taps, _phases);
+}
+
+/**
+ * @brief decimate the input to the output rate
+ * @param in input samples, at the SID clock
+ * @param count number of input samples
+ * @return number of samples produced in _out
+ */
+int CAudio::resample(const int16_t *in, int count) {
+    int produced = 0;
+    for (int i = 0; i < count; i++) {
+        // push into the mirrored ring
+        _historyPos++;
+        if (_historyPos == _taps) {
+            _historyPos = 0;
+        }
+        float s = in[i];
+        _history[_historyPos] = s;
+        _history[_historyPos + _taps] = s;
+
+        _acc += (1ULL << 32);
+        if (_acc < _step) {
+            continue;
+        }
+
+        // an output instant passed, filter the last _taps samples with the
+        // phase matching how long ago it was
+        _acc -= _step;
+        int phase = (int)(_acc >> (32 - _phaseShift));
+        const float *window = &_history[_historyPos + 1];
+        float v = dotProduct(window, &_coeffs[phase * _taps], _taps);
+        if (v > 32767) {
+            v = 32767;
+        } else if (v < -32768) {
+            v = -32768;
+        }
+        if (produced < _outSize) {
+            _out[produced++] = (int16_t)lrintf(v);
+        }
+    }
+    return produced;
+}
+
+/**
+ * @brief write the (little endian) WAV header, sizes are taken from the
+ * samples written so far
+ */
+void CAudio::writeWavHeader() {
+    uint32_t dataSize = _fileSamples * sizeof(int16_t);
+    uint32_t byteRate = _outputHz * sizeof(int16_t);
+    uint32_t fields[] = {36 + dataSize, 16, 0x00010001, (uint32_t)_outputHz,
+                         byteRate, 0x00100002, dataSize};
+    uint8_t hdr[44];
+    memcpy(hdr, "RIFF", 4);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    memcpy(hdr + 36, "data", 4);
+    int offsets[] = {4, 16, 20, 24, 28, 32, 40};
+    for (int i = 0; i < 7; i++) {
+        for (int b = 0; b < 4; b++) {
+            hdr[offsets[i] + b] = (uint8_t)(fields[i] >> (b * 8));
+        }
+    }
+    fwrite(hdr, sizeof(hdr), 1, _file);
+}
+
+int CAudio::openFile(const char *path) {
+    closeFile();
+    _file = fopen(path, "wb");
+    if (!_file) {
+        int res = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
+                     path);
+        return res;
+    }
+    size_t l = strlen(path);
+    _fileIsWav = !(l > 4 && strcmp(path + l - 4, ".raw") == 0);
+    _fileSamples = 0;
+    if (_fileIsWav) {
+        // sizes are fixed on close
+        writeWavHeader();
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "writing audio to %s (%s, %dhz, 16 bit mono)", path,
+                _fileIsWav ? "wav" : "raw", _outputHz);
+    return 0;
+}
+
+void CAudio::closeFile() {
+    if (!_file) {
+        return;
+    }
+    if (_fileIsWav && fseek(_file, 0, SEEK_SET) == 0) {
+        // patch the header with the final sizes (not possible on pipes)
+        writeWavHeader();
+    }
+    fclose(_file);
+    _file = nullptr;
+}
+
+int CAudio::update() {
+    int count;
+    int16_t *in = _sid->samples(&count);
+    int produced = resample(in, count);
+    _sid->consumeSamples();
+    if (produced == 0) {
+        return 0;
+    }
+    if (_device != 0) {
+        // queue to the device, unless it's already too much behind
+        uint32_t queued = SDL_GetQueuedAudioSize(_device);
+        uint32_t maxQueued =
+            (_outputHz * AUDIO_MAX_QUEUED_MSEC / 1000) * sizeof(int16_t);
+        if (queued < maxQueued) {
+            SDL_QueueAudio(_device, _out, produced * sizeof(int16_t));
+        }
+    }
+    if (_file) {
+        // samples are written little endian whatever the host is, swap in
+        // place since we're done with them
+        uint8_t *le = (uint8_t *)_out;
+        for (int i = 0; i < produced; i++) {
+            uint16_t v = (uint16_t)_out[i];
+            le[i * 2] = (uint8_t)(v & 0xff);
+            le[i * 2 + 1] = (uint8_t)(v >> 8);
+        }
+        fwrite(le, produced * sizeof(int16_t), 1, _file);
+        _fileSamples += produced;
+    }
+    return 0;
+}
@@ -4,13 +4,93 @@
 #pragma once
 
 #include "CSID.h"
+#include <SDL.h>
+#include <stdio.h>
 
+/**
+ * @brief resampler quality presets (filter taps/phases, see CAudio.cpp)
+ */
+#define AUDIO_QUALITY_FAST 0
+#define AUDIO_QUALITY_MEDIUM 1
+#define AUDIO_QUALITY_HIGH 2
+
+/**
+ * @brief host output sample rate we ask for, the device may give us another
+ */
+#define AUDIO_OUTPUT_HZ 48000
+
+/**
+ * @brief do not queue more than this to the device, or latency keeps growing
+ * since emulation is not locked to the audio clock
+ */
+#define AUDIO_MAX_QUEUED_MSEC 100
+
+/**
+ * @brief handles emulator audio output, decimating the SID output from the
+ * cpu clock to the host sample rate through a polyphase windowed-sinc FIR.
+ * output goes to the audio device and/or to a WAV or raw PCM file
+ */
 class CAudio {
   public:
-    CAudio(CSID *sid);
+    /**
+     * @brief constructor
+     * @param sid the SID chip
+     * @param clockHz the SID clock (= cpu clock)
+     * @param quality one of the AUDIO_QUALITY presets
+     * @param useDevice false to not open the audio device (headless)
+     */
+    CAudio(CSID *sid, int clockHz, int quality = AUDIO_QUALITY_MEDIUM,
+           bool useDevice = true);
     ~CAudio();
+
+    /**
+     * @brief write the resampled output to file too (16 bit signed, mono)
+     * @param path path to the file, written as raw PCM if it ends with .raw,
+     * either as WAV
+     * @return 0 on success, or errno
+     */
+    int openFile(const char *path);
+
+    /**
+     * @brief finalize and close the output file, if any
+     */
+    void closeFile();
+
+    /**
+     * @brief drain the SID samples, resample them and queue them to the
+     * audio device. to be called once per frame
+     * @return 0
+     */
     int update();
 
   private:
     CSID *_sid = nullptr;
+    SDL_AudioDeviceID _device = 0;
+    int _outputHz = AUDIO_OUTPUT_HZ;
+
+    // filter bank, _phases * _taps coefficients
+    float *_coeffs = nullptr;
+    int _taps = 0;
+    int _phases = 0;
+    int _phaseShift = 0;
+
+    // mirrored history ring (2 * _taps), so the filter window is contiguous
+    float *_history = nullptr;
+    int _historyPos = 0;
+
+    // input samples per output sample and elapsed input time since the last
+    // output sample, 32.32 fixed point
+    uint64_t _step = 0;
+    uint64_t _acc = 0;
+
+    int16_t *_out = nullptr;
+    int _outSize = 0;
+
+    FILE *_file = nullptr;
+    bool _fileIsWav = false;
+    uint32_t _fileSamples = 0;
+
+    void initFilter(int clockHz, int quality);
+    int resample(const int16_t *in, int count);
+    void writeWavHeader();
 };
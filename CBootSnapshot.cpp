@@ -0,0 +1,113 @@
+#include "CBootSnapshot.h"
+#include <SDL.h>
+#include <CBuffer.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief writing here restores the RAM
+ */
+#define TRAP_REG_RESTORE 0x70
+
+/**
+ * @brief the resume stub
+ */
+static const uint8_t resumeStub[] = {
+    0x78,             // sei
+    0xd8,             // cld
+    0x8d, 0xf0, 0xdf, // sta $dff0 (restore ram, unpatch reset)
+    0xa2, 0xff,       // ldx #$ff
+    0x9a,             // txs
+    0x20, 0xa3, 0xfd, // jsr $fda3 (IOINIT, CIAs and timer)
+    0x20, 0xa0, 0xe5, // jsr $e5a0 (VIC registers)
+    0xa2, 0xfb,       // ldx #$fb
+    0x9a,             // txs (as BASIC cold start)
+    0x58,             // cli
+    0x4c, 0x80, 0xa4, // jmp $a480 (BASIC main loop)
+};
+
+CBootSnapshot::CBootSnapshot(CMemory *mem) {
+    _mem = mem;
+    memcpy(_stub, resumeStub, sizeof(resumeStub));
+}
+
+CBootSnapshot::~CBootSnapshot() { SAFE_FREE(_ram) }
+
+bool CBootSnapshot::load(const char *biosPath, int vicModel) {
+    // the snapshot is valid only for the same ROMs and vic model
+    static const char *models[] = {"pal", "ntsc", "ntscold"};
+    uint64_t hash = _mem->romsHash();
+    hash = (hash ^ (uint64_t)vicModel) * 0x100000001b3ULL;
+    snprintf(_path, sizeof(_path), "%s/boot-%s-%016llx.snap", biosPath,
+             models[vicModel], (unsigned long long)hash);
+
+    // load the snapshot
+    uint8_t *buf;
+    uint32_t size;
+    if (CBuffer::fromFile(_path, &buf, &size) != 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "no boot snapshot, it will be saved to %s", _path);
+        return false;
+    }
+    size_t l = strlen(BOOT_SNAPSHOT_MAGIC);
+    if (size != l + 1 + MEMORY_SIZE ||
+        memcmp(buf, BOOT_SNAPSHOT_MAGIC, l) != 0 ||
+        buf[l] != BOOT_SNAPSHOT_VERSION) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "invalid boot snapshot %s, it will be saved again", _path);
+        free(buf);
+        return false;
+    }
+    _ram = (uint8_t *)calloc(1, MEMORY_SIZE);
+    memcpy(_ram, buf + l + 1, MEMORY_SIZE);
+    free(buf);
+
+    // the reset routine jumps to our stub
+    _mem->readBytes(KERNAL_RESET_ADDRESS, _resetCode, sizeof(_resetCode),
+                    sizeof(_resetCode));
+    uint8_t jmp[] = {0x4c, BOOT_SNAPSHOT_TRAP_START & 0xff,
+                     BOOT_SNAPSHOT_TRAP_START >> 8};
+    _mem->patchRom(KERNAL_RESET_ADDRESS, jmp, sizeof(jmp));
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "resuming boot snapshot %s",
+                _path);
+    return true;
+}
+
+int CBootSnapshot::save() {
+    if (_path[0] == '\0') {
+        return EINVAL;
+    }
+    FILE *f = fopen(_path, "wb");
+    if (!f) {
+        int res = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
+                     _path);
+        return res;
+    }
+    uint32_t size;
+    uint8_t *ram = _mem->raw(&size);
+    fwrite(BOOT_SNAPSHOT_MAGIC, strlen(BOOT_SNAPSHOT_MAGIC), 1, f);
+    fputc(BOOT_SNAPSHOT_VERSION, f);
+    fwrite(ram, size, 1, f);
+    fclose(f);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "boot snapshot saved to %s",
+                _path);
+    return 0;
+}
+
+void CBootSnapshot::read(uint16_t address, uint8_t *bt) {
+    *bt = _stub[address - BOOT_SNAPSHOT_TRAP_START];
+}
+
+void CBootSnapshot::write(uint16_t address, uint8_t bt) {
+    if (address - BOOT_SNAPSHOT_TRAP_START != TRAP_REG_RESTORE || !_ram) {
+        return;
+    }
+
+    // restore ram (through writeByte, so $00/$01 setup the mapping), and the
+    // reset routine so that the next resets boot normally
+    _mem->writeBytes(0, _ram, MEMORY_SIZE);
+    _mem->patchRom(KERNAL_RESET_ADDRESS, _resetCode, sizeof(_resetCode));
+    SAFE_FREE(_ram)
+}
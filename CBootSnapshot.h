@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include "CMemory.h"
+
+/**
+ * @brief the resume stub lives in the upper half of the I/O2 area
+ */
+#define BOOT_SNAPSHOT_TRAP_START 0xdf80
+#define BOOT_SNAPSHOT_TRAP_END 0xdfff
+
+/**
+ * @brief snapshot file magic, followed by the format version and the RAM
+ */
+#define BOOT_SNAPSHOT_MAGIC "VC64BOOT"
+#define BOOT_SNAPSHOT_VERSION 2
+
+/**
+ * @brief kernal reset routine (where the reset vector points)
+ */
+#define KERNAL_RESET_ADDRESS 0xfce2
+
+/**
+ * @brief caches the machine state right after the kernal cold start (BASIC
+ * waiting for input), keyed by the vic model and a hash of the ROMs, so that
+ * the next runs can skip the boot. the model matters since the cold start
+ * detects PAL/NTSC ($02a6), which the resume stub doesn't.
+ *
+ * to resume, the reset routine is patched to jump to a stub which restores
+ * the RAM, initializes the I/O chips through the kernal (IOINIT, VIC init)
+ * and enters the BASIC main loop.
+ */
+class CBootSnapshot {
+  public:
+    /**
+     * @brief constructor
+     * @param mem the emulated memory
+     */
+    CBootSnapshot(CMemory *mem);
+    ~CBootSnapshot();
+
+    /**
+     * @brief hash the ROMs and load the snapshot matching them and the vic
+     * model, if any. if found, the kernal is patched so that the boot resumes
+     * from the snapshot
+     * @param biosPath path to the folder where snapshots are cached
+     * @param vicModel the vic model (VIC_MODEL_*)
+     * @return true if the snapshot will be resumed
+     */
+    bool load(const char *biosPath, int vicModel);
+
+    /**
+     * @brief save the snapshot, to be called once BASIC is up (only if
+     * load() failed)
+     * @return 0 on success, or errno
+     */
+    int save();
+
+    /**
+     * @brief read from the trap area, the cpu executes the stub from here
+     * @param address the address, in the trap area
+     * @param bt on return, the byte
+     */
+    void read(uint16_t address, uint8_t *bt);
+
+    /**
+     * @brief write to the trap area, which triggers the restore
+     * @param address the address, in the trap area
+     * @param bt the byte
+     */
+    void write(uint16_t address, uint8_t bt);
+
+  private:
+    CMemory *_mem = nullptr;
+    char _path[260] = {0};
+    uint8_t *_ram = nullptr;
+    uint8_t _resetCode[3] = {0};
+    uint8_t _stub[BOOT_SNAPSHOT_TRAP_END - BOOT_SNAPSHOT_TRAP_START + 1] = {0};
+};
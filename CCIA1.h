@@ -13,6 +13,7 @@
  */
 class CCIA1 : public CCIABase {
     friend class CInput;
+    friend class CMovie;
 
   public:
     CCIA1(CMOS65xx *cpu, CPLA* pla);
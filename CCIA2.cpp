@@ -56,26 +56,41 @@ void CCIA2::setVicBank(uint8_t pra) {
 }
 
 void CCIA2::read(uint16_t address, uint8_t *bt) {
-    switch (address) {
+    // check shadow address
+    uint16_t addr = handleShadowAddress(address);
+    switch (addr) {
     default:
         // default processing with the base class
-        CCIABase::read(address, bt);
+        CCIABase::read(addr, bt);
     }
 }
 
 void CCIA2::write(uint16_t address, uint8_t bt) {
-    switch (address) {
+    // check shadow address
+    uint16_t addr = handleShadowAddress(address);
+    switch (addr) {
     case 0xdd00:
         // PRA
         // set the vic bank and address
         // @todo handle other bits
         setVicBank(bt);
-        CCIABase::write(address, bt);
+        CCIABase::write(addr, bt);
         break;
 
     default:
         // default processing with the base class
-        CCIABase::write(address, bt);
+        CCIABase::write(addr, bt);
         break;
     }
 }
+
+/**
+ * @brief cia2 registers are mirrored at $DD10-$DDFF every 16 bytes
+ * @param address the input address
+ * @return the effective address
+ */
+uint16_t CCIA2::handleShadowAddress(uint16_t address) {
+    // check for shadow addresses
+    uint16_t addr = CIA2_REGISTERS_START + (address & 0xf);
+    return addr;
+}
@@ -24,4 +24,5 @@ class CCIA2 : public CCIABase {
     int _vicBank = 0;
     uint16_t _vicMemory = 0;
     void setVicBank(uint8_t pra);
+    uint16_t handleShadowAddress(uint16_t address);
 };
@@ -0,0 +1,234 @@
+#include "CCapture.h"
+#include <SDL.h>
+#include <CBuffer.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * @brief ARGB8888 to Y, U, V planes (BT.601, limited range)
+ * @param src source row
+ * @param y Y plane row
+ * @param u U plane row
+ * @param v V plane row
+ * @param n pixels
+ */
+static void rgbToYuv(const uint32_t *src, uint8_t *y, uint8_t *u, uint8_t *v,
+                     int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    // pixels are B,G,R,A bytes, coefficients as (b,g),(r,a) pairs
+    const __m128i cy = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+    const __m128i cu = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+    const __m128i cv = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i yOffset = _mm_set1_epi32(16);
+    const __m128i uvOffset = _mm_set1_epi32(128);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(px, zero);
+        __m128i hi = _mm_unpackhi_epi8(px, zero);
+        __m128i c[3] = {cy, cu, cv};
+        __m128i offset[3] = {yOffset, uvOffset, uvOffset};
+        uint8_t *dst[3] = {y + i, u + i, v + i};
+        for (int p = 0; p < 3; p++) {
+            // (b,g) and (r,a) sums of pixels 0,1 and 2,3, added in pairs
+            __m128 a = _mm_castsi128_ps(_mm_madd_epi16(lo, c[p]));
+            __m128 b = _mm_castsi128_ps(_mm_madd_epi16(hi, c[p]));
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, 0x88));
+            __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, 0xdd));
+            __m128i s = _mm_add_epi32(even, odd);
+            s = _mm_srai_epi32(_mm_add_epi32(s, round), 8);
+            s = _mm_add_epi32(s, offset[p]);
+            s = _mm_packs_epi32(s, s);
+            s = _mm_packus_epi16(s, s);
+            int32_t packed = _mm_cvtsi128_si32(s);
+            memcpy(dst[p], &packed, 4);
+        }
+    }
+#elif defined(__ARM_NEON)
+    // deinterleaved B,G,R,A of 8 pixels
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x4_t px = vld4_u8((const uint8_t *)(src + i));
+        int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(px.val[0]));
+        int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(px.val[1]));
+        int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(px.val[2]));
+
+        // Y fits unsigned 16 bits only
+        uint16x8_t sy = vmull_u8(px.val[2], vdup_n_u8(66));
+        sy = vmlal_u8(sy, px.val[1], vdup_n_u8(129));
+        sy = vmlal_u8(sy, px.val[0], vdup_n_u8(25));
+        sy = vaddq_u16(vshrq_n_u16(vaddq_u16(sy, vdupq_n_u16(128)), 8),
+                       vdupq_n_u16(16));
+        vst1_u8(y + i, vmovn_u16(sy));
+
+        int16x8_t su = vmulq_n_s16(b, 112);
+        su = vmlaq_n_s16(su, g, -74);
+        su = vmlaq_n_s16(su, r, -38);
+        su = vaddq_s16(vrshrq_n_s16(su, 8), vdupq_n_s16(128));
+        vst1_u8(u + i, vqmovun_s16(su));
+
+        int16x8_t sv = vmulq_n_s16(r, 112);
+        sv = vmlaq_n_s16(sv, g, -94);
+        sv = vmlaq_n_s16(sv, b, -18);
+        sv = vaddq_s16(vrshrq_n_s16(sv, 8), vdupq_n_s16(128));
+        vst1_u8(v + i, vqmovun_s16(sv));
+    }
+#endif
+    for (; i < n; i++) {
+        int b = src[i] & 0xff;
+        int g = (src[i] >> 8) & 0xff;
+        int r = (src[i] >> 16) & 0xff;
+        y[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+/**
+ * @brief ARGB8888 to RGB24
+ * @param src source row
+ * @param dst destination row
+ * @param n pixels
+ */
+static void rgbToRgb24(const uint32_t *src, uint8_t *dst, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i * 3] = (src[i] >> 16) & 0xff;
+        dst[i * 3 + 1] = (src[i] >> 8) & 0xff;
+        dst[i * 3 + 2] = src[i] & 0xff;
+    }
+}
+
+CCapture::CCapture(int srcW, int srcH, int fpsNum, int fpsDen,
+                   CScaler *scaler) {
+    _scaler = scaler;
+    _w = scaler ? scaler->width() : srcW;
+    _h = scaler ? scaler->height() : srcH;
+
+    // reduce the frame rate
+    int a = fpsNum;
+    int b = fpsDen;
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    _fpsNum = fpsNum / a;
+    _fpsDen = fpsDen / a;
+    if (scaler) {
+        _scaled = (uint32_t *)calloc(_w * _h, sizeof(uint32_t));
+    }
+
+    // both Y,U,V planes and RGB24 take 3 bytes per pixel
+    _out = (uint8_t *)calloc(_w * _h, 3);
+}
+
+CCapture::~CCapture() {
+    if (_file) {
+        fclose(_file);
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "capture: %lld frames",
+                    (long long)_frames);
+    }
+    SAFE_FREE(_scaled)
+    SAFE_FREE(_out)
+}
+
+/**
+ * @brief describe the raw RGB24 stream, in path.txt
+ * @param path path to the stream
+ * @return 0 on success, or errno
+ */
+int CCapture::writeSidecar(const char *path) {
+    std::string sidecar = std::string(path) + ".txt";
+    FILE *f = fopen(sidecar.c_str(), "w");
+    if (!f) {
+        int res = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
+                     sidecar.c_str());
+        return res;
+    }
+    fprintf(f, "format=rgb24\nwidth=%d\nheight=%d\nfps=%d/%d\n", _w, _h,
+            _fpsNum, _fpsDen);
+    fprintf(f,
+            "# ffmpeg -f rawvideo -pixel_format rgb24 -video_size %dx%d "
+            "-framerate %d/%d -i %s out.mp4\n",
+            _w, _h, _fpsNum, _fpsDen, path);
+    fclose(f);
+    return 0;
+}
+
+int CCapture::open(const char *path) {
+    if (!_out || (_scaler && !_scaled)) {
+        return ENOMEM;
+    }
+    _file = fopen(path, "wb");
+    if (!_file) {
+        int res = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
+                     path);
+        return res;
+    }
+    size_t l = strlen(path);
+    _isRgb = (l > 4 && strcmp(path + l - 4, ".rgb") == 0);
+    if (_isRgb) {
+        int res = writeSidecar(path);
+        if (res != 0) {
+            return res;
+        }
+    } else {
+        fprintf(_file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444 XYSCSS=444\n",
+                _w, _h, _fpsNum, _fpsDen);
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "capturing video to %s (%s, %dx%d, %d/%d fps)", path,
+                _isRgb ? "rgb24" : "y4m", _w, _h, _fpsNum, _fpsDen);
+    return 0;
+}
+
+/**
+ * @brief write the converted frame
+ */
+void CCapture::writeFrame() {
+    if (!_isRgb) {
+        fputs("FRAME\n", _file);
+    }
+    fwrite(_out, _w * _h, 3, _file);
+    _frames++;
+}
+
+void CCapture::write(const uint32_t *frame, int pitch) {
+    if (!_file) {
+        return;
+    }
+    if (_scaler) {
+        _scaler->scale(frame, pitch, _scaled, _w);
+        frame = _scaled;
+        pitch = _w;
+    }
+    int planeSize = _w * _h;
+    for (int row = 0; row < _h; row++) {
+        const uint32_t *src = frame + (row * pitch);
+        if (_isRgb) {
+            rgbToRgb24(src, _out + (row * _w * 3), _w);
+        } else {
+            int offset = row * _w;
+            rgbToYuv(src, _out + offset, _out + planeSize + offset,
+                     _out + (2 * planeSize) + offset, _w);
+        }
+    }
+    writeFrame();
+}
+
+void CCapture::repeat() {
+    if (!_file || _frames == 0) {
+        return;
+    }
+    writeFrame();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "CScaler.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief writes the emulated display to a YUV4MPEG2 stream (4:4:4, BT.601
+ * limited range), or to raw RGB24 with a text sidecar describing it (path
+ * ending with .rgb)
+ */
+class CCapture {
+  public:
+    /**
+     * @brief constructor
+     * @param srcW frame width
+     * @param srcH frame height
+     * @param fpsNum frame rate numerator (i.e. the vic clock)
+     * @param fpsDen frame rate denominator (i.e. the cycles per frame)
+     * @param scaler if not nullptr, frames are scaled before being written
+     */
+    CCapture(int srcW, int srcH, int fpsNum, int fpsDen,
+             CScaler *scaler = nullptr);
+    ~CCapture();
+
+    /**
+     * @brief open the output, which may be a pipe
+     * @param path path to the output
+     * @return 0 on success, or errno
+     */
+    int open(const char *path);
+
+    /**
+     * @brief write a frame
+     * @param frame the ARGB8888 frame
+     * @param pitch row length, in pixels
+     */
+    void write(const uint32_t *frame, int pitch);
+
+    /**
+     * @brief write the last frame again (the frame was skipped)
+     */
+    void repeat();
+
+  private:
+    FILE *_file = nullptr;
+    bool _isRgb = false;
+    int _w = 0;
+    int _h = 0;
+    int _fpsNum = 0;
+    int _fpsDen = 1;
+    CScaler *_scaler = nullptr;
+    uint32_t *_scaled = nullptr;
+    uint8_t *_out = nullptr; // the converted frame
+    int64_t _frames = 0;
+
+    int writeSidecar(const char *path);
+    void writeFrame();
+};
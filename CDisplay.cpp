@@ -9,20 +9,30 @@
 #include <string>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int CDisplay::initializeDisplay(bool fullScreen, const char *wndName,
                                 char **errorString) {
-    if (!wndName || !errorString) {
+    if ((!wndName && !_offscreen) || !errorString) {
         return EINVAL;
     }
     *errorString = nullptr;
     bool ok = false;
     do {
+        if (_offscreen) {
+            // just the framebuffers
+            _pxFormat = SDL_AllocFormat(SDL_PIXELFORMAT_ARGB8888);
+            ok = (_pxFormat != nullptr);
+            break;
+        }
+
         // set the display windows big as twice as the real emulated display
+        // (or as the scaled one)
         int scaleFactor = 2;
+        int w = _scaler ? _scaler->width() : VIC_SCREEN_W * scaleFactor;
+        int h = _scaler ? _scaler->height() : VIC_SCREEN_H * scaleFactor;
         _window = SDL_CreateWindow(
-            wndName, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-            VIC_PAL_SCREEN_W * scaleFactor, VIC_PAL_SCREEN_H * scaleFactor,
+            wndName, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, w, h,
             fullScreen ? SDL_WINDOW_FULLSCREEN : SDL_WINDOW_RESIZABLE);
         if (!_window) {
             break;
@@ -35,9 +45,10 @@ int CDisplay::initializeDisplay(bool fullScreen, const char *wndName,
         if (!_renderer) {
             break;
         }
-        _texture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_ARGB8888,
-                                     SDL_TEXTUREACCESS_STREAMING,
-                                     VIC_PAL_SCREEN_W, VIC_PAL_SCREEN_H);
+        _texture = SDL_CreateTexture(
+            _renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+            _scaler ? _scaler->width() : VIC_SCREEN_W,
+            _scaler ? _scaler->height() : VIC_SCREEN_H);
         if (!_texture) {
             break;
         }
@@ -45,6 +56,9 @@ int CDisplay::initializeDisplay(bool fullScreen, const char *wndName,
         if (!_pxFormat) {
             break;
         }
+        if (_zeroCopy && lockTexture() != 0) {
+            break;
+        }
         ok = true;
     } while (0);
 
@@ -56,44 +70,170 @@ int CDisplay::initializeDisplay(bool fullScreen, const char *wndName,
     return 0;
 }
 
-CDisplay::CDisplay(CVICII *vic, const char *wndName, bool fullScreen) {
-    // allocate the texture memory for the framebuffer
-    _fb = (uint32_t *)calloc(1, (VIC_PAL_SCREEN_W * VIC_PAL_SCREEN_H) *
-                                    sizeof(uint32_t));
+/**
+ * @brief allocate the framebuffers, when not drawing into the texture
+ * @return 0 on success, or errno
+ */
+int CDisplay::allocateFramebuffers() {
+    for (int i = 0; i < 3; i++) {
+        _fbs[i] = (uint32_t *)calloc(1, (VIC_SCREEN_W * VIC_SCREEN_H) *
+                                            sizeof(uint32_t));
+        if (!_fbs[i]) {
+            return ENOMEM;
+        }
+    }
+    _fb = _fbs[_drawing];
+    _pitch = VIC_SCREEN_W;
+    return 0;
+}
+
+/**
+ * @brief lock the texture, the vic draws the next frame into its memory
+ * @return 0 on success, or errno
+ */
+int CDisplay::lockTexture() {
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(_texture, NULL, &pixels, &pitch) != 0) {
+        return ECANCELED;
+    }
+    _fb = (uint32_t *)pixels;
+    _pitch = pitch / sizeof(uint32_t);
+
+    // the locked memory is undefined, clear the rows the vic never draws
+    // (as the framebuffers, they're black)
+    for (int y = _vic->screenRows(); y < VIC_SCREEN_H; y++) {
+        memset(_fb + y * _pitch, 0, VIC_SCREEN_W * sizeof(uint32_t));
+    }
+    return 0;
+}
+
+CDisplay::CDisplay(CVICII *vic, const char *wndName, bool fullScreen,
+                   bool asyncPresent, bool zeroCopy, CScaler *scaler)
+    : _ready(1) {
     _vic = vic;
+    _offscreen = (wndName == nullptr);
+    _asyncPresent = asyncPresent && !_offscreen;
+    _scaler = scaler;
 
-    char *sdlError;
-    int res = initializeDisplay(fullScreen, wndName, &sdlError);
-    if (res != 0) {
-        throw std::runtime_error(std::string(sdlError));
+    // the texture can't be locked by the thread calling update() with
+    // asyncPresent, and holds the scaled frame with the scaler
+    _zeroCopy = zeroCopy && !_asyncPresent && !scaler && !_offscreen;
+    bool ok = false;
+    std::string error;
+    if (!_zeroCopy && allocateFramebuffers() != 0) {
+        error = "can't allocate the framebuffers";
+    } else {
+        char *sdlError;
+        if (initializeDisplay(fullScreen, wndName, &sdlError) != 0) {
+            error = sdlError ? sdlError : "can't initialize the display";
+        } else {
+            ok = true;
+        }
+    }
+    if (!ok) {
+        // the destructor won't run, free what has been created so far
+        release();
+        throw std::runtime_error(error);
     }
 
     // set callbacks
-    vic->setBlitCallback(this, CDisplay::blitCallback);
+    if (_zeroCopy) {
+        vic->setBlitCallback(this, CDisplay::blitCallbackPitch);
+    } else {
+        vic->setBlitCallback(this, CDisplay::blitCallback);
+    }
 
     // show!
     update();
+    present();
 }
 
-CDisplay::~CDisplay() {
+CDisplay::~CDisplay() { release(); }
+
+/**
+ * @brief free the SDL objects and the framebuffers
+ */
+void CDisplay::release() {
     if (_pxFormat) {
         SDL_FreeFormat(_pxFormat);
+        _pxFormat = nullptr;
     }
     if (_texture) {
         SDL_DestroyTexture(_texture);
+        _texture = nullptr;
     }
     if (_renderer) {
         SDL_DestroyRenderer(_renderer);
+        _renderer = nullptr;
     }
     if (_window) {
         SDL_DestroyWindow(_window);
+        _window = nullptr;
+    }
+    for (int i = 0; i < 3; i++) {
+        SAFE_FREE(_fbs[i])
     }
-    SAFE_FREE(_fb)
 }
 
 void CDisplay::update() {
-    // update the framebuffer
-    SDL_UpdateTexture(_texture, NULL, _fb, VIC_PAL_SCREEN_W * sizeof(uint32_t));
+    if (_zeroCopy) {
+        // the vic has drawn straight into the texture
+        if (_capture) {
+            _capture->write(_fb, _pitch);
+        }
+        SDL_UnlockTexture(_texture);
+        SDL_RenderClear(_renderer);
+        SDL_RenderCopy(_renderer, _texture, NULL, NULL);
+        SDL_RenderPresent(_renderer);
+        if (lockTexture() != 0) {
+            // draw into our own framebuffers from now on
+            SDL_LogError(SDL_LOG_CATEGORY_ERROR, "SDL_LockTexture(): %s",
+                         SDL_GetError());
+            if (allocateFramebuffers() != 0) {
+                throw std::runtime_error("can't allocate the framebuffers");
+            }
+            _zeroCopy = false;
+            _vic->setBlitCallback(this, CDisplay::blitCallback);
+        }
+        return;
+    }
+
+    // the frame is complete and replaces the one waiting, if it wasn't
+    // presented yet. the vic continues in the framebuffer released
+    int completed = _drawing;
+    if (_capture) {
+        _capture->write(_fbs[completed], VIC_SCREEN_W);
+    }
+    _drawing = _ready.exchange(completed | DISPLAY_FB_NEW) & 0x3;
+
+    // the vic only draws the lines which changed since the previous frame
+    memcpy(_fbs[_drawing], _fbs[completed],
+           VIC_SCREEN_W * VIC_SCREEN_H * sizeof(uint32_t));
+    _fb = _fbs[_drawing];
+    if (!_asyncPresent && !_offscreen) {
+        present();
+    }
+}
+
+void CDisplay::present() {
+    if (_zeroCopy || _offscreen || !(_ready.load() & DISPLAY_FB_NEW)) {
+        return;
+    }
+    _presenting = _ready.exchange(_presenting) & 0x3;
+    if (_scaler) {
+        // scale straight into the texture
+        void *pixels;
+        int pitch;
+        if (SDL_LockTexture(_texture, NULL, &pixels, &pitch) == 0) {
+            _scaler->scale(_fbs[_presenting], VIC_SCREEN_W,
+                           (uint32_t *)pixels, pitch / sizeof(uint32_t));
+            SDL_UnlockTexture(_texture);
+        }
+    } else {
+        SDL_UpdateTexture(_texture, NULL, _fbs[_presenting],
+                          VIC_SCREEN_W * sizeof(uint32_t));
+    }
     SDL_RenderClear(_renderer);
     SDL_RenderCopy(_renderer, _texture, NULL, NULL);
     SDL_RenderPresent(_renderer);
@@ -103,4 +243,16 @@ void CDisplay::blitCallback(void *thisPtr, RgbStruct *rgb, int pos) {
     // blit the pixel
     CDisplay *d = (CDisplay *)thisPtr;
     d->_fb[pos] = SDL_MapRGB(d->_pxFormat, rgb->r, rgb->g, rgb->b);
-}
\ No newline at end of file
+}
+
+void CDisplay::blitCallbackPitch(void *thisPtr, RgbStruct *rgb, int pos) {
+    // the texture rows may be padded
+    CDisplay *d = (CDisplay *)thisPtr;
+    int y = pos / VIC_SCREEN_W;
+    d->_fb[pos + y * (d->_pitch - VIC_SCREEN_W)] =
+        SDL_MapRGB(d->_pxFormat, rgb->r, rgb->g, rgb->b);
+}
+
+bool CDisplay::isZeroCopy() { return _zeroCopy; }
+
+void CDisplay::setCapture(CCapture *capture) { _capture = capture; }
\ No newline at end of file
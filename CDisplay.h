@@ -4,7 +4,16 @@
 #pragma once
 
 #include "CVICII.h"
+#include "CCapture.h"
+#include "CScaler.h"
 #include <SDL.h>
+#include <atomic>
+
+/**
+ * @brief set in the ready framebuffer index, when it holds a frame not
+ * presented yet
+ */
+#define DISPLAY_FB_NEW 0x4
 
 /**
  * @brief implements emulator display (VIC)
@@ -12,18 +21,35 @@
 class CDisplay {
   public:
     /**
-     * update the display
+     * the frame is complete, present it (or just hand it over, with
+     * asyncPresent)
      */
     void update();
 
+    /**
+     * @brief present the last complete frame, if not presented yet. with
+     * asyncPresent, it's called by the thread which created the display
+     */
+    void present();
+
     /**
      * constructor
      * @param vic the vic-ii chip
-     * @param wndName name of the window, for windowed mode
+     * @param wndName name of the window, for windowed mode. if nullptr, the
+     * display is offscreen (just the framebuffers, i.e. to capture headless)
      * @param fullScreen true for fullscreen (default is windowed)
+     * @param asyncPresent true if update() is called by another thread,
+     * which never waits for the display (the frames are presented with
+     * present())
+     * @param zeroCopy true to draw straight into the texture memory (ignored
+     * with asyncPresent or scaler)
+     * @param scaler if not nullptr, frames are scaled on the cpu into a
+     * texture as big as the scaled frame
      * @throws std::runtime_error on error
      */
-    CDisplay(CVICII *vic, const char *wndName, bool fullScreen = false);
+    CDisplay(CVICII *vic, const char *wndName, bool fullScreen = false,
+             bool asyncPresent = false, bool zeroCopy = false,
+             CScaler *scaler = nullptr);
     ~CDisplay();
 
     /**
@@ -31,14 +57,53 @@ class CDisplay {
      */
     static void blitCallback(void *thisPtr, RgbStruct *rgb, int pos);
 
+    /**
+     * @brief called by vic when blitting into the locked texture
+     */
+    static void blitCallbackPitch(void *thisPtr, RgbStruct *rgb, int pos);
+
+    /**
+     * @brief check if the vic draws straight into the texture, which doesn't
+     * keep its content between frames
+     * @return bool
+     */
+    bool isZeroCopy();
+
+    /**
+     * @brief write each frame to a capture, as it's completed
+     * @param capture the capture, or nullptr to stop
+     */
+    void setCapture(CCapture *capture);
+
   private:
     SDL_Window *_window = nullptr;
     SDL_Renderer *_renderer = nullptr;
     SDL_Texture *_texture = nullptr;
     SDL_PixelFormat *_pxFormat = nullptr;
-    uint32_t *_fb = nullptr;
+    uint32_t *_fb = nullptr; // the framebuffer being drawn
+    int _pitch = VIC_SCREEN_W; // in pixels
+
+    // the vic draws into the locked texture
+    bool _zeroCopy = false;
+    CScaler *_scaler = nullptr;
+    CCapture *_capture = nullptr;
+    bool _offscreen = false;
     CVICII *_vic = nullptr;
 
+    // triple buffering: the vic draws into one framebuffer, the last
+    // complete frame waits in another, the third is being presented
+    uint32_t *_fbs[3] = {};
+    int _drawing = 0;
+    std::atomic<int> _ready;
+    int _presenting = 2;
+
+    // the frames are presented by the thread which created the display
+    bool _asyncPresent = false;
+
+    int allocateFramebuffers();
+    int lockTexture();
+    void release();
+
     /**
      * initializes the display (a texture) through SDL
      * @param fullScreen true for full screen
@@ -0,0 +1,118 @@
+#include "CHeatmap.h"
+#include <SDL.h>
+#include <CBuffer.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+CHeatmap::CHeatmap(const char *spec) {
+    long long start;
+    long long end;
+    int consumed = 0;
+    if (sscanf(spec, "%lld:%lld:%n", &start, &end, &consumed) == 2 &&
+        consumed > 0 && spec[consumed] != '\0' && start >= 0 && end > start) {
+        _start = start;
+        _end = end;
+        _prefix = spec + consumed;
+    }
+    for (int i = 0; i < 3; i++) {
+        _counts[i] = (uint32_t *)calloc(0x10000, sizeof(uint32_t));
+    }
+}
+
+CHeatmap::~CHeatmap() {
+    for (int i = 0; i < 3; i++) {
+        SAFE_FREE(_counts[i])
+    }
+}
+
+bool CHeatmap::isValid() { return !_prefix.empty(); }
+
+void CHeatmap::update(int64_t frames) {
+    if (_done) {
+        return;
+    }
+    if (!_active && frames >= _start && frames < _end) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "heatmap: counting, frame=%lld", (long long)frames);
+        _active = true;
+    } else if (_active && frames >= _end) {
+        finish();
+    }
+}
+
+void CHeatmap::finish() {
+    if (!_active) {
+        return;
+    }
+    _active = false;
+    _done = true;
+    exportCsv();
+    exportPgm();
+}
+
+/**
+ * @brief address,reads,writes,executes for each address accessed
+ */
+void CHeatmap::exportCsv() {
+    std::string path = _prefix + ".csv";
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(errno),
+                     path.c_str());
+        return;
+    }
+    fprintf(f, "address,reads,writes,executes\n");
+    for (int a = 0; a < 0x10000; a++) {
+        uint32_t r = _counts[HEATMAP_READ][a];
+        uint32_t w = _counts[HEATMAP_WRITE][a];
+        uint32_t x = _counts[HEATMAP_EXECUTE][a];
+        if (r | w | x) {
+            fprintf(f, "$%04x,%u,%u,%u\n", a, r, w, x);
+        }
+    }
+    fclose(f);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "heatmap saved to %s",
+                path.c_str());
+}
+
+/**
+ * @brief binary PGM, reads/writes/executes side by side. each panel is a
+ * 256x256 grid where y is the page and x the offset in the page, brightness
+ * is log(count) relative to the hottest address of the panel
+ */
+void CHeatmap::exportPgm() {
+    std::string path = _prefix + ".pgm";
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(errno),
+                     path.c_str());
+        return;
+    }
+    double scale[3];
+    for (int t = 0; t < 3; t++) {
+        uint32_t max = 0;
+        for (int a = 0; a < 0x10000; a++) {
+            if (_counts[t][a] > max) {
+                max = _counts[t][a];
+            }
+        }
+        scale[t] = max ? 255.0 / log1p((double)max) : 0;
+    }
+    fprintf(f, "P5\n%d %d\n255\n", 256 * 3, 256);
+    uint8_t row[256 * 3];
+    for (int page = 0; page < 256; page++) {
+        for (int t = 0; t < 3; t++) {
+            for (int x = 0; x < 256; x++) {
+                uint32_t c = _counts[t][(page << 8) | x];
+                row[t * 256 + x] = (uint8_t)(log1p((double)c) * scale[t]);
+            }
+        }
+        fwrite(row, sizeof(row), 1, f);
+    }
+    fclose(f);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "heatmap saved to %s",
+                path.c_str());
+}
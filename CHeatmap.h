@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+/**
+ * @brief counter types
+ */
+#define HEATMAP_READ 0
+#define HEATMAP_WRITE 1
+#define HEATMAP_EXECUTE 2
+
+/**
+ * @brief counts reads, writes and executes per address over a range of
+ * frames, then exports them as CSV and as a PGM image (three 256x256 panels,
+ * one pixel per address, log scaled)
+ */
+class CHeatmap {
+  public:
+    /**
+     * @brief constructor
+     * @param spec start:end:prefix, frames in [start,end) are profiled and
+     * exported to prefix.csv and prefix.pgm
+     */
+    CHeatmap(const char *spec);
+    ~CHeatmap();
+
+    /**
+     * @brief check if the spec given to the constructor was valid
+     * @return bool
+     */
+    bool isValid();
+
+    /**
+     * @brief check if counting
+     * @return bool
+     */
+    inline bool isActive() { return _active; }
+
+    /**
+     * @brief count an access, only if active
+     * @param address the address
+     * @param type one of the HEATMAP types
+     */
+    inline void count(uint16_t address, int type) {
+        if (_active) {
+            _counts[type][address]++;
+        }
+    }
+
+    /**
+     * @brief to be called at every frame, starts/stops counting and exports
+     * @param frames total frames elapsed
+     */
+    void update(int64_t frames);
+
+    /**
+     * @brief export now, if still counting (i.e. at exit)
+     */
+    void finish();
+
+  private:
+    uint32_t *_counts[3] = {nullptr};
+    int64_t _start = -1;
+    int64_t _end = -1;
+    std::string _prefix = {};
+    bool _active = false;
+    bool _done = false;
+
+    void exportCsv();
+    void exportPgm();
+};
@@ -5,9 +5,14 @@
 #include "CInput.h"
 #include <SDL.h>
 #include <bitutils.h>
+#include <CBuffer.h>
+#include <errno.h>
+#include <stdio.h>
+#include <strings.h>
 CInput::CInput(CCIA1 *cia1, int joyConfiguration) {
     _cia1 = cia1;
     _joyNum = joyConfiguration;
+    _pasteRing = (uint8_t *)calloc(1, CLIPBOARD_RING_SIZE);
     switch (_joyNum) {
     case 1:
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -25,154 +30,100 @@ CInput::CInput(CCIA1 *cia1, int joyConfiguration) {
     }
 }
 
-CInput::~CInput() {}
+CInput::~CInput() { SAFE_FREE(_pasteRing) }
 
 /**
- * @brief populates a queue with events from string on clipboard, when pasting
- * text into the emulator
- * @todo rework the mapping!
- * @todo support tags like {CLR/HOME}, etc....
- * @todo this may be rewritten exploiting the keyboard buffer at 631 as well (as
- * for injecting RUN....)
- * @see @ref sdlScancodeToC64Scancode for information about the mapping
+ * @brief convert an ASCII character to PETSCII, as typed in uppercase mode
+ * @param c the character
+ * @return the PETSCII character, or 0 if it can't be typed
  */
+uint8_t CInput::asciiToPetscii(char c) {
+    if (c == '\n' || c == '\r') {
+        // RETURN
+        return 13;
+    }
+    if (c == '\t') {
+        return ' ';
+    }
+    if (c >= 'a' && c <= 'z') {
+        // unshifted letters are uppercase
+        return (uint8_t)toupper(c);
+    }
+    if (c < ' ' || c > ']') {
+        // control characters, {|}~ and anything non-ASCII have no match
+        return 0;
+    }
+    return (uint8_t)c;
+}
+
+/**
+ * @brief queue text to be typed through the keyboard buffer
+ * @param text the text, ASCII
+ */
+void CInput::pasteText(const char *text) {
+    for (const char *p = text; *p; p++) {
+        if (*p == '\n' && p > text && p[-1] == '\r') {
+            // CRLF is a single RETURN
+            continue;
+        }
+        uint8_t c = asciiToPetscii(*p);
+        if (c == 0) {
+            continue;
+        }
+        if (_pasteHead - _pasteTail == CLIPBOARD_RING_SIZE) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "paste buffer full, text truncated!");
+            break;
+        }
+        _pasteRing[_pasteHead & (CLIPBOARD_RING_SIZE - 1)] = c;
+        _pasteHead++;
+    }
+}
+
 void CInput::fillClipboardQueue() {
     char *txt = SDL_GetClipboardText();
     if (!txt) {
         // clipboard empty
         return;
     }
-
-    // push a keydown/keyup event for each key in the string
-    int l = strlen(txt);
 #ifdef DEBUG_INPUT
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION,
                  "pushing to keyboard input queue: %s", txt);
 #endif
-    for (int i = 0; i < l; i++) {
-        bool addShift = false;
-        // allocate
-        SDL_Event *evDown = (SDL_Event *)calloc(1, sizeof(SDL_Event));
-        SDL_Event *evUp = (SDL_Event *)calloc(1, sizeof(SDL_Event));
-
-        // build the events
-        SDL_Keycode c = tolower(txt[i]);
-        SDL_Scancode s;
-        switch (c) {
-        case SDLK_EQUALS:
-            s = SDL_SCANCODE_EQUALS;
-            break;
-
-            // return is both 0x0d and 0x0a
-        case SDLK_RETURN:
-        case 0x0a:
-            s = SDL_SCANCODE_RETURN;
-            break;
-
-        case SDLK_COLON:
-            s = SDL_SCANCODE_SEMICOLON;
-            break;
-
-        case SDLK_PLUS:
-            s = SDL_SCANCODE_BACKSLASH;
-            break;
-
-        case SDLK_DOLLAR:
-            s = SDL_SCANCODE_4;
-            addShift = true;
-            break;
-
-        case SDLK_LEFTPAREN:
-            s = SDL_SCANCODE_8;
-            addShift = true;
-            break;
-
-        case SDLK_RIGHTPAREN:
-            s = SDL_SCANCODE_9;
-            addShift = true;
-            break;
-
-        case SDLK_SEMICOLON:
-            s = SDL_SCANCODE_APOSTROPHE;
-
-            break;
-
-        default:
-            s = SDL_GetScancodeFromKey(c);
-            break;
-        }
-        //#ifdef DEBUG_INPUT
-        SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION,
-                     "key pushed to keyboard input queue: %c", txt[i]);
-        //#endif
-        if (addShift) {
-            // key is shifted
-            SDL_Event *evShiftDown = (SDL_Event *)calloc(1, sizeof(SDL_Event));
-            evShiftDown->key.keysym.scancode = SDL_SCANCODE_LSHIFT;
-            evShiftDown->key.keysym.sym = SDLK_LSHIFT;
-            evShiftDown->type = SDL_KEYDOWN;
-
-            // push shift down to the queue
-            _kqueue.push(evShiftDown);
-        }
-        evDown->key.keysym.scancode = s;
-        evDown->key.keysym.sym = c;
-        evDown->type = SDL_KEYDOWN;
-        evUp->key.keysym.scancode = s;
-        evUp->key.keysym.sym = c;
-        evUp->type = SDL_KEYUP;
-
-        // push to the queue
-        _kqueue.push(evDown);
-        _kqueue.push(evUp);
-
-        if (addShift) {
-            // key is shifted
-            SDL_Event *evShiftUp = (SDL_Event *)calloc(1, sizeof(SDL_Event));
-            evShiftUp->key.keysym.scancode = SDL_SCANCODE_LSHIFT;
-            evShiftUp->key.keysym.sym = SDLK_LSHIFT;
-            evShiftUp->type = SDL_KEYUP;
-
-            // push shift down to the queue
-            _kqueue.push(evShiftUp);
-        }
-    }
+    pasteText(txt);
     SDL_free(txt);
 }
 
-/**
- * processes the clipboard queue by injecting the events into the emulated
- * keyboard (useful to type listings!)
- */
-void CInput::processClipboardQueue() {
-    // pop an event
-    SDL_Event *ev = _kqueue.front();
-    _kqueue.pop();
-
-    // process event
-    processEvent(ev);
-    free(ev);
-}
+void CInput::checkClipboard() {
+    if (_pasteHead == _pasteTail) {
+        return;
+    }
 
-/*
- * returns wether the clipboard queue has events to be injected
- */
-bool CInput::hasClipboardEvents() {
-    int l = _kqueue.size();
-#ifdef DEBUG_INPUT
-    if (l > 0) {
-        SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION,
-                     "keyboard input queue size: %d", l);
+    // wait for the kernal to drain the keyboard buffer, then refill it
+    uint8_t pending;
+    _cia1->_cpu->memory()->readByte(198, &pending, true);
+    if (pending != 0) {
+        return;
     }
-#endif
-    if (l != 0) {
-        // has events!
-        return true;
+    char chunk[11];
+    int n = 0;
+    while (n < 10 && _pasteTail != _pasteHead) {
+        chunk[n++] = _pasteRing[_pasteTail & (CLIPBOARD_RING_SIZE - 1)];
+        _pasteTail++;
     }
-    return false;
+    chunk[n] = '\0';
+    injectKeyboardBuffer(chunk);
 }
 
 void CInput::injectKeyboardBuffer(const char *chars) {
+    if (_movie) {
+        if (_movie->isPlaying()) {
+            // the movie is in control
+            return;
+        }
+        _movie->keyboardBuffer(chars);
+    }
+
     // get memory object from cia1
     IMemory *mem = _cia1->_cpu->memory();
 
@@ -196,22 +147,266 @@ void CInput::injectKeyboardBuffer(const char *chars) {
     mem->writeByte(198, written);
 }
 
-void CInput::checkClipboard(int64_t totalCycles, int cyclesPerFrame,
-                            int frameSkip) {
-    int toSkip = cyclesPerFrame * frameSkip;
-    if (_prevTotalCycles == 0) {
-        // init
-        _prevTotalCycles = totalCycles;
+void CInput::setMovie(CMovie *movie) { _movie = movie; }
+
+/**
+ * @brief all key transitions go through here, so they can be recorded (or
+ * ignored, while playing back a movie)
+ * @param scancode the c64 scancode
+ * @param pressed true if pressed
+ */
+void CInput::setKeyState(uint8_t scancode, bool pressed) {
+    if (_movie) {
+        if (_movie->isPlaying()) {
+            return;
+        }
+        _movie->keyState(scancode, pressed);
+    }
+    _cia1->setKeyState(scancode, pressed);
+}
+
+/**
+ * @brief RESTORE, triggers a nmi
+ */
+void CInput::restore() {
+    if (_movie) {
+        if (_movie->isPlaying()) {
+            return;
+        }
+        _movie->restore();
+    }
+    _cia1->_cpu->nmi();
+}
+
+/**
+ * @brief c64 key names usable in input scripts, with their scancode
+ * @see @ref sdlScancodeToC64Scancode
+ */
+static const struct {
+    const char *name;
+    uint8_t scancode;
+} scriptKeys[] = {
+    {"DEL", 0x00},       {"RETURN", 0x01},    {"CRSRRIGHT", 0x02},
+    {"F7", 0x03},        {"F1", 0x04},        {"F3", 0x05},
+    {"F5", 0x06},        {"CRSRDOWN", 0x07},  {"3", 0x08},
+    {"W", 0x09},         {"A", 0x0a},         {"4", 0x0b},
+    {"Z", 0x0c},         {"S", 0x0d},         {"E", 0x0e},
+    {"LSHIFT", 0x0f},    {"5", 0x10},         {"R", 0x11},
+    {"D", 0x12},         {"6", 0x13},         {"C", 0x14},
+    {"F", 0x15},         {"T", 0x16},         {"X", 0x17},
+    {"7", 0x18},         {"Y", 0x19},         {"G", 0x1a},
+    {"8", 0x1b},         {"B", 0x1c},         {"H", 0x1d},
+    {"U", 0x1e},         {"V", 0x1f},         {"9", 0x20},
+    {"I", 0x21},         {"J", 0x22},         {"0", 0x23},
+    {"M", 0x24},         {"K", 0x25},         {"O", 0x26},
+    {"N", 0x27},         {"PLUS", 0x28},      {"P", 0x29},
+    {"L", 0x2a},         {"MINUS", 0x2b},     {"PERIOD", 0x2c},
+    {"COLON", 0x2d},     {"AT", 0x2e},        {"COMMA", 0x2f},
+    {"POUND", 0x30},     {"ASTERISK", 0x31},  {"SEMICOLON", 0x32},
+    {"HOME", 0x33},      {"RSHIFT", 0x34},    {"EQUALS", 0x35},
+    {"UPARROW", 0x36},   {"SLASH", 0x37},     {"1", 0x38},
+    {"LEFTARROW", 0x39}, {"CTRL", 0x3a},      {"2", 0x3b},
+    {"SPACE", 0x3c},     {"CBM", 0x3d},       {"Q", 0x3e},
+    {"RUNSTOP", 0x3f},
+};
+
+/**
+ * @brief parse a script line
+ * @param line the line, modified in place
+ * @param ev on return, the event
+ * @return 0 on success, ENOENT for empty/comment lines, or EINVAL
+ */
+int CInput::parseScriptLine(char *line, ScriptEvent *ev) {
+    // strip newline and leading blanks
+    line[strcspn(line, "\r\n")] = '\0';
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    if (*line == '\0' || *line == '#') {
+        return ENOENT;
     }
-    int diff = totalCycles - _prevTotalCycles;
 
-    // every 4 frames, check the clipboard
-    if (diff > toSkip) {
-        // check the clipboard queue, and process one event if not empty
-        if (hasClipboardEvents()) {
-            processClipboardQueue();
+    // <frame|cycle> <n>: <command> [args]
+    char unit[16];
+    long long when;
+    int consumed = 0;
+    if (sscanf(line, "%15s %lld :%n", unit, &when, &consumed) < 2 ||
+        consumed == 0) {
+        return EINVAL;
+    }
+    if (strcmp(unit, "frame") == 0) {
+        ev->isFrame = true;
+    } else if (strcmp(unit, "cycle") == 0) {
+        ev->isFrame = false;
+    } else {
+        return EINVAL;
+    }
+    ev->when = when;
+    char *cmd = line + consumed;
+    while (*cmd == ' ' || *cmd == '\t') {
+        cmd++;
+    }
+    char *args = cmd + strcspn(cmd, " \t");
+    if (*args != '\0') {
+        *args++ = '\0';
+    }
+
+    if (strcmp(cmd, "type") == 0) {
+        // the rest of the line, \n or \r is RETURN, \\ is a backslash.
+        // lowercase is converted to (unshifted) PETSCII uppercase
+        ev->cmd = SCRIPT_CMD_TYPE;
+        for (char *p = args; *p; p++) {
+            char c = *p;
+            if (c == '\\' && p[1]) {
+                p++;
+                c = (*p == 'n' || *p == 'r') ? '\r' : *p;
+            }
+            ev->text.push_back((char)toupper(c));
+        }
+        return 0;
+    }
+    if (strcmp(cmd, "keydown") == 0 || strcmp(cmd, "keyup") == 0) {
+        ev->cmd =
+            strcmp(cmd, "keydown") == 0 ? SCRIPT_CMD_KEYDOWN : SCRIPT_CMD_KEYUP;
+        for (size_t i = 0; i < sizeof(scriptKeys) / sizeof(scriptKeys[0]);
+             i++) {
+            if (strcasecmp(args, scriptKeys[i].name) == 0) {
+                ev->arg = scriptKeys[i].scancode;
+                return 0;
+            }
         }
-        _prevTotalCycles = totalCycles;
+        return EINVAL;
+    }
+    if (strcmp(cmd, "joy") == 0) {
+        // whitespace separated directions/fire, or none
+        ev->cmd = SCRIPT_CMD_JOY;
+        ev->arg = 0;
+        for (char *tok = strtok(args, " \t"); tok;
+             tok = strtok(nullptr, " \t")) {
+            if (strcmp(tok, "up") == 0) {
+                ev->arg |= SCRIPT_JOY_UP;
+            } else if (strcmp(tok, "down") == 0) {
+                ev->arg |= SCRIPT_JOY_DOWN;
+            } else if (strcmp(tok, "left") == 0) {
+                ev->arg |= SCRIPT_JOY_LEFT;
+            } else if (strcmp(tok, "right") == 0) {
+                ev->arg |= SCRIPT_JOY_RIGHT;
+            } else if (strcmp(tok, "fire") == 0) {
+                ev->arg |= SCRIPT_JOY_FIRE;
+            } else if (strcmp(tok, "none") != 0) {
+                return EINVAL;
+            }
+        }
+        return 0;
+    }
+    if (strcmp(cmd, "restore") == 0) {
+        ev->cmd = SCRIPT_CMD_RESTORE;
+        return 0;
+    }
+    if (strcmp(cmd, "quit") == 0) {
+        ev->cmd = SCRIPT_CMD_QUIT;
+        return 0;
+    }
+    return EINVAL;
+}
+
+/**
+ * @brief load an input script. each line is an event stamped with emulated
+ * time, events are replayed in file order:
+ *
+ * # comment
+ * frame 150: type LOAD"*",8,1\n
+ * frame 300: keydown RETURN
+ * frame 302: keyup RETURN
+ * cycle 4000000: joy up fire
+ * frame 420: joy none
+ * frame 500: restore
+ * frame 900: quit
+ *
+ * keys are named as in the scriptKeys table, joystick goes through the same
+ * keyboard matrix shortcuts used for the host arrow keys.
+ */
+int CInput::loadScript(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        int res = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
+                     path);
+        return res;
+    }
+    _script.clear();
+    _scriptPos = 0;
+    char line[1024];
+    int n = 0;
+    int res = 0;
+    while (fgets(line, sizeof(line), f)) {
+        n++;
+        ScriptEvent ev = {0, false, 0, 0, std::string()};
+        int r = parseScriptLine(line, &ev);
+        if (r == ENOENT) {
+            continue;
+        }
+        if (r != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "%s: invalid script line %d", path, n);
+            res = r;
+            break;
+        }
+        _script.push_back(ev);
+    }
+    fclose(f);
+    if (res == 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "loaded input script: %s, %d events", path,
+                    (int)_script.size());
+    }
+    return res;
+}
+
+/**
+ * @brief replay a script event
+ * @param ev the event
+ * @param hotkeys on return, HOTKEY_FORCE_EXIT if the script asked to quit
+ */
+void CInput::runScriptEvent(ScriptEvent *ev, uint32_t *hotkeys) {
+    switch (ev->cmd) {
+    case SCRIPT_CMD_TYPE:
+        // fed to the keyboard buffer as it drains, as pasted text
+        pasteText(ev->text.c_str());
+        break;
+    case SCRIPT_CMD_KEYDOWN:
+    case SCRIPT_CMD_KEYUP:
+        setKeyState(ev->arg, ev->cmd == SCRIPT_CMD_KEYDOWN);
+        break;
+    case SCRIPT_CMD_JOY:
+        // same mapping as handleJoystick()
+        setKeyState(0x38, (ev->arg & SCRIPT_JOY_UP) != 0);
+        setKeyState(0x39, (ev->arg & SCRIPT_JOY_DOWN) != 0);
+        setKeyState(0x3a, (ev->arg & SCRIPT_JOY_LEFT) != 0);
+        setKeyState(0x3b, (ev->arg & SCRIPT_JOY_RIGHT) != 0);
+        setKeyState(0x3c, (ev->arg & SCRIPT_JOY_FIRE) != 0);
+        break;
+    case SCRIPT_CMD_RESTORE:
+        restore();
+        break;
+    case SCRIPT_CMD_QUIT:
+        *hotkeys = HOTKEY_FORCE_EXIT;
+        break;
+    default:
+        break;
+    }
+}
+
+void CInput::checkScript(int64_t totalCycles, int64_t frames,
+                         uint32_t *hotkeys) {
+    while (_scriptPos < _script.size()) {
+        ScriptEvent *ev = &_script[_scriptPos];
+        int64_t now = ev->isFrame ? frames : totalCycles;
+        if (now < ev->when) {
+            break;
+        }
+        runScriptEvent(ev, hotkeys);
+        _scriptPos++;
     }
 }
 
@@ -229,32 +424,32 @@ bool CInput::handleJoystick(uint32_t sdlScanCode, bool pressed) {
     case SDL_SCANCODE_LEFT:
         // ctrl
         c64ScanCode = 0x3a;
-        _cia1->setKeyState(c64ScanCode, pressed);
+        setKeyState(c64ScanCode, pressed);
         return true;
 
     case SDL_SCANCODE_RIGHT:
         // 2
         c64ScanCode = 0x3b;
-        _cia1->setKeyState(c64ScanCode, pressed);
+        setKeyState(c64ScanCode, pressed);
         return true;
 
     case SDL_SCANCODE_UP:
         // 1
         c64ScanCode = 0x38;
-        _cia1->setKeyState(c64ScanCode, pressed);
+        setKeyState(c64ScanCode, pressed);
         return true;
 
     case SDL_SCANCODE_DOWN:
         // <-
         c64ScanCode = 0x39;
-        _cia1->setKeyState(c64ScanCode, pressed);
+        setKeyState(c64ScanCode, pressed);
         return true;
 
     case SDL_SCANCODE_LSHIFT:
         // fire button
         // space
         c64ScanCode = 0x3c;
-        _cia1->setKeyState(c64ScanCode, pressed);
+        setKeyState(c64ScanCode, pressed);
         return true;
     }
 
@@ -287,33 +482,44 @@ void CInput::processEvent(SDL_Event *ev) {
         uint8_t scancode = sdlScancodeToC64Scancode(sds);
         if (scancode != 0xff) {
             // update internal keyboard state
-            _cia1->setKeyState(scancode, pressed);
+            setKeyState(scancode, pressed);
         }
     }
 }
 
 int CInput::update(SDL_Event *ev, uint32_t *hotkeys) {
-    // we have a keyup or keydown
-    const uint8_t *keys = SDL_GetKeyboardState(nullptr);
+    // we have a keyup or keydown. the hotkeys are checked on the event
+    // itself, it may have been queued for a while (the live keyboard state
+    // may have changed already)
+    SDL_Scancode sc = ev->key.keysym.scancode;
+    bool down = (ev->type == SDL_KEYDOWN);
+    bool ctrl = (ev->key.keysym.mod & KMOD_LCTRL) != 0;
+    if (sc == SDL_SCANCODE_TAB) {
+        _runStopDown = down;
+    }
 
     // check hotkeys
-    if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_D]) {
+    if (down && ctrl && sc == SDL_SCANCODE_D) {
         // break requested!
         *hotkeys = HOTKEY_DEBUGGER;
         return 0;
-    } else if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_J]) {
+    } else if (down && ctrl && sc == SDL_SCANCODE_J) {
         // enable/disable joy2 hack
         *hotkeys = HOTKEY_JOY2_HACK_SWITCH;
         return 0;
-    } else if (keys[SDL_SCANCODE_TAB] && keys[SDL_SCANCODE_BACKSPACE]) {
+    } else if (down && _runStopDown && sc == SDL_SCANCODE_BACKSPACE) {
         // runstop + restore causes a nonmaskable interrupt
-        _cia1->_cpu->nmi();
+        restore();
         return 0;
-    } else if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_V]) {
+    } else if (down && ctrl && sc == SDL_SCANCODE_V) {
         // handle clipboard copying keystrokes to the input queue
         *hotkeys = HOTKEY_PASTE_TEXT;
         return 0;
-    } else if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_ESCAPE]) {
+    } else if (down && ctrl && sc == SDL_SCANCODE_T) {
+        // dump watchpoints trace
+        *hotkeys = HOTKEY_DUMP_TRACE;
+        return 0;
+    } else if (down && ctrl && sc == SDL_SCANCODE_ESCAPE) {
         // force exit
         *hotkeys = HOTKEY_FORCE_EXIT;
         return 0;
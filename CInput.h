@@ -4,8 +4,10 @@
 #pragma once
 
 #include "CCIA1.h"
+#include "CMovie.h"
 #include <SDL.h>
-#include <queue>
+#include <string>
+#include <vector>
 
 /**
  * @brief pressing ctrl-d enters the debugger, softice style :)
@@ -28,6 +30,46 @@
  */
 #define HOTKEY_JOY2_HACK_SWITCH 4
 
+/**
+ * @brief pressing ctrl-t dumps the watchpoints trace
+ */
+#define HOTKEY_DUMP_TRACE 5
+
+/**
+ * @brief size of the pasted text ring (power of 2)
+ */
+#define CLIPBOARD_RING_SIZE 0x10000
+
+/**
+ * @brief input script commands
+ */
+#define SCRIPT_CMD_TYPE 0
+#define SCRIPT_CMD_KEYDOWN 1
+#define SCRIPT_CMD_KEYUP 2
+#define SCRIPT_CMD_JOY 3
+#define SCRIPT_CMD_RESTORE 4
+#define SCRIPT_CMD_QUIT 5
+
+/**
+ * @brief joystick bits for SCRIPT_CMD_JOY
+ */
+#define SCRIPT_JOY_UP 1
+#define SCRIPT_JOY_DOWN 2
+#define SCRIPT_JOY_LEFT 4
+#define SCRIPT_JOY_RIGHT 8
+#define SCRIPT_JOY_FIRE 16
+
+/**
+ * @brief an input script event, stamped with emulated time
+ */
+typedef struct _scriptEvent {
+    int64_t when;       // frame or cycle number
+    bool isFrame;       // true if when is a frame number
+    int cmd;            // one of the SCRIPT_CMD
+    uint8_t arg;        // c64 scancode or joystick bits
+    std::string text;   // text to type (PETSCII)
+} ScriptEvent;
+
 /**
  * @brief handles emulator input
  * special keys:
@@ -56,20 +98,22 @@ class CInput {
     int update(SDL_Event *ev, uint32_t *hotkeys);
 
     /**
-     * fills the clipboard queue with fake keyboard events, in response to
-     * HOTKEY_PASTE_TEXT
+     * queues the clipboard text to be typed, in response to HOTKEY_PASTE_TEXT
      */
     void fillClipboardQueue();
 
     /**
-     * called at every redraw, handles events in the clipboard queue, if any
-     *
-     * @param totalCycles total cpu cycles elapsed
-     * @param cyclesPerFrame how many cpu cycles in a frame
-     * @param frameSkip how many frames to skip before injecting clipboard, if
-     * any
+     * called at every redraw, refills the keyboard buffer with queued
+     * (pasted/scripted) text, up to 10 characters at a time, once the kernal
+     * has drained it
+     */
+    void checkClipboard();
+
+    /**
+     * queue text to be typed through the keyboard buffer, as pasted
+     * @param text the text, ASCII (newlines are RETURN)
      */
-    void checkClipboard(int64_t totalCycles, int cyclesPerFrame, int frameSkip);
+    void pasteText(const char *text);
 
     /**
      * inject characters in the keyboard buffer
@@ -77,14 +121,45 @@ class CInput {
      */
     void injectKeyboardBuffer(const char *chars);
 
+    /**
+     * @brief load an input script, to be replayed through checkScript()
+     * @see CInput.cpp for the format
+     * @param path path to the script
+     * @return 0 on success, or errno
+     */
+    int loadScript(const char *path);
+
+    /**
+     * @brief to be called after every cpu step, replays the script events
+     * which are due
+     * @param totalCycles total cpu cycles elapsed
+     * @param frames total frames elapsed
+     * @param hotkeys on return, HOTKEY_FORCE_EXIT if the script asked to quit
+     */
+    void checkScript(int64_t totalCycles, int64_t frames, uint32_t *hotkeys);
+
+    /**
+     * @brief record input to (or play it back from) a movie
+     * @param movie the movie, or nullptr
+     */
+    void setMovie(CMovie *movie);
+
   private:
     CCIA1 *_cia1 = nullptr;
-    std::queue<SDL_Event *> _kqueue = {};
+    CMovie *_movie = nullptr;
+    void setKeyState(uint8_t scancode, bool pressed);
+    void restore();
     uint8_t sdlScancodeToC64Scancode(uint32_t sdlScanCode);
     void processEvent(SDL_Event *ev);
-    int64_t _prevTotalCycles = 0;
     int _joyNum = 0;
-    void processClipboardQueue();
-    bool hasClipboardEvents();
+    bool _runStopDown = false; // tab, as of the last event
+    uint8_t *_pasteRing = nullptr;
+    uint32_t _pasteHead = 0;
+    uint32_t _pasteTail = 0;
+    uint8_t asciiToPetscii(char c);
     bool handleJoystick(uint32_t sdlScanCode, bool pressed);
+    std::vector<ScriptEvent> _script = {};
+    size_t _scriptPos = 0;
+    int parseScriptLine(char *line, ScriptEvent *ev);
+    void runScriptEvent(ScriptEvent *ev, uint32_t *hotkeys);
 };
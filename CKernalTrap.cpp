@@ -0,0 +1,456 @@
+#include "CKernalTrap.h"
+#include <SDL.h>
+#include <CBuffer.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/**
+ * @brief the trap result register, 0 = ok, KERNAL_TRAP_PASSTHROUGH = let the
+ * kernal handle it, anything else is a kernal error code
+ */
+#define TRAP_REG_LOAD 0x70
+#define TRAP_REG_RESULT 0x71
+#define TRAP_REG_SAVE 0x72
+#define KERNAL_TRAP_PASSTHROUGH 0xff
+#define KERNAL_ERROR_MISSING_FILENAME 8
+
+/**
+ * @brief the stubs, the original vectors are patched in at install()
+ */
+#define TRAP_LOAD_STUB 0x00
+#define TRAP_LOAD_STUB_JMP 0x18
+#define TRAP_SAVE_STUB 0x20
+#define TRAP_SAVE_STUB_JMP 0x2e
+static const uint8_t loadStub[] = {
+    0x85, 0x93,       // sta $93 (verify flag, as the kernal does)
+    0x8d, 0x70, 0xdf, // sta $df70 (trap)
+    0xad, 0x71, 0xdf, // lda $df71 (result)
+    0xc9, 0xff,       // cmp #$ff
+    0xf0, 0x09,       // beq passthrough
+    0xa6, 0xae,       // ldx $ae (end address)
+    0xa4, 0xaf,       // ldy $af
+    0xc9, 0x01,       // cmp #$01 (carry set on error)
+    0x60,             // rts
+    0xea, 0xea,       // nop, nop
+    0xa5, 0x93,       // passthrough: lda $93
+    0x4c, 0x00, 0x00, // jmp (original ILOAD)
+};
+static const uint8_t saveStub[] = {
+    0x8d, 0x72, 0xdf, // sta $df72 (trap)
+    0xad, 0x71, 0xdf, // lda $df71 (result)
+    0xc9, 0xff,       // cmp #$ff
+    0xf0, 0x03,       // beq passthrough
+    0xc9, 0x01,       // cmp #$01 (carry set on error)
+    0x60,             // rts
+    0x4c, 0x00, 0x00, // passthrough: jmp (original ISAVE)
+};
+
+/**
+ * @brief match a filename against a CBM pattern (* matches the rest, ? any
+ * character), case insensitive
+ */
+static bool cbmMatch(const char *pattern, const char *name) {
+    for (; *pattern; pattern++, name++) {
+        if (*pattern == '*') {
+            return true;
+        }
+        if (*name == '\0') {
+            return false;
+        }
+        if (*pattern != '?' && tolower(*pattern) != tolower(*name)) {
+            return false;
+        }
+    }
+    return *name == '\0';
+}
+
+/**
+ * @brief get the offset of a sector in a .d64 image
+ * @return the offset, or -1 if invalid
+ */
+static int d64SectorOffset(int track, int sector) {
+    // sectors per track: 21 (1-17), 19 (18-24), 18 (25-30), 17 (31-40)
+    static const int zones[][2] = {{17, 21}, {24, 19}, {30, 18}, {40, 17}};
+    int offset = 0;
+    for (int t = 1; t < track; t++) {
+        for (int z = 0; z < 4; z++) {
+            if (t <= zones[z][0]) {
+                offset += zones[z][1];
+                break;
+            }
+        }
+    }
+    if (track < 1 || track > 40 || sector < 0 || sector > 20) {
+        return -1;
+    }
+    return (offset + sector) * 256;
+}
+
+CKernalTrap::CKernalTrap(CMemory *mem) {
+    _mem = mem;
+    memcpy(&_stub[TRAP_LOAD_STUB], loadStub, sizeof(loadStub));
+    memcpy(&_stub[TRAP_SAVE_STUB], saveStub, sizeof(saveStub));
+}
+
+CKernalTrap::~CKernalTrap() {}
+
+/**
+ * @brief map the device to the source slot
+ * @return 0 (device 8), 1 (device 1) or -1
+ */
+int CKernalTrap::sourceIndex(int device) {
+    if (device == 8) {
+        return 0;
+    }
+    if (device == 1) {
+        return 1;
+    }
+    return -1;
+}
+
+int CKernalTrap::attach(int device, const char *path) {
+    int idx = sourceIndex(device);
+    if (idx < 0) {
+        return EINVAL;
+    }
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        int res = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
+                     path);
+        return res;
+    }
+    _source[idx] = path;
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "device %d: %s", device, path);
+    return 0;
+}
+
+bool CKernalTrap::isAttached(int device) {
+    int idx = sourceIndex(device);
+    return idx >= 0 && !_source[idx].empty();
+}
+
+int CKernalTrap::install() {
+    // chain to the original handlers for the other devices
+    _mem->readWord(KERNAL_VECTOR_ILOAD, &_iload);
+    _mem->readWord(KERNAL_VECTOR_ISAVE, &_isave);
+    _stub[TRAP_LOAD_STUB_JMP] = _iload & 0xff;
+    _stub[TRAP_LOAD_STUB_JMP + 1] = _iload >> 8;
+    _stub[TRAP_SAVE_STUB_JMP] = _isave & 0xff;
+    _stub[TRAP_SAVE_STUB_JMP + 1] = _isave >> 8;
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "kernal LOAD/SAVE traps installed, ILOAD=$%04x, ISAVE=$%04x",
+                _iload, _isave);
+    return 0;
+}
+
+void CKernalTrap::checkVectors() {
+    // RESTOR copies the table to $0330/$0332 at boot (and on RUNSTOP+RESTORE)
+    uint16_t iload;
+    uint16_t isave;
+    _mem->readWord(KERNAL_RAM_VECTOR_ILOAD, &iload);
+    _mem->readWord(KERNAL_RAM_VECTOR_ISAVE, &isave);
+    if (iload == _iload) {
+        uint16_t stub = KERNAL_TRAP_START + TRAP_LOAD_STUB;
+        _mem->writeByte(KERNAL_RAM_VECTOR_ILOAD, stub & 0xff);
+        _mem->writeByte(KERNAL_RAM_VECTOR_ILOAD + 1, stub >> 8);
+    }
+    if (isave == _isave) {
+        uint16_t stub = KERNAL_TRAP_START + TRAP_SAVE_STUB;
+        _mem->writeByte(KERNAL_RAM_VECTOR_ISAVE, stub & 0xff);
+        _mem->writeByte(KERNAL_RAM_VECTOR_ISAVE + 1, stub >> 8);
+    }
+}
+
+void CKernalTrap::read(uint16_t address, uint8_t *bt) {
+    *bt = _stub[address - KERNAL_TRAP_START];
+}
+
+void CKernalTrap::write(uint16_t address, uint8_t bt) {
+    switch (address - KERNAL_TRAP_START) {
+    case TRAP_REG_LOAD:
+        _stub[TRAP_REG_RESULT] = trapLoad();
+        break;
+    case TRAP_REG_SAVE:
+        _stub[TRAP_REG_RESULT] = trapSave();
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief get the filename from the kernal, as lowercase ASCII with the drive
+ * prefix ("0:", "@0:") stripped
+ * @param name on return, the filename
+ * @param size size of the name buffer
+ */
+void CKernalTrap::filename(char *name, int size) {
+    uint8_t len;
+    uint16_t addr;
+    _mem->readByte(ZEROPAGE_KERNAL_FNLEN, &len, true);
+    _mem->readWord(ZEROPAGE_KERNAL_FNADDR, &addr, true);
+    int n = 0;
+    for (int i = 0; i < len && n < size - 1; i++) {
+        uint8_t c;
+        _mem->readByte(addr + i, &c);
+        name[n++] = (char)tolower(c & 0x7f);
+    }
+    name[n] = '\0';
+    char *colon = strchr(name, ':');
+    if (colon) {
+        memmove(name, colon + 1, strlen(colon));
+    }
+}
+
+/**
+ * @brief find a file in a folder, the .prg extension is optional
+ * @param folder the folder
+ * @param name the CBM filename (may have wildcards), empty for the first file
+ * @param path on return, path to the file (the first in alphabetical order
+ * matching)
+ * @return 0 on success, or ENOENT
+ */
+int CKernalTrap::findInFolder(const std::string &folder, const char *name,
+                              std::string &path) {
+    DIR *d = opendir(folder.c_str());
+    if (!d) {
+        return ENOENT;
+    }
+    std::string found;
+    struct dirent *e;
+    while ((e = readdir(d)) != nullptr) {
+        if (e->d_name[0] == '.') {
+            continue;
+        }
+        std::string n = e->d_name;
+        size_t l = n.size();
+        bool isPrg = (l > 4 && strcasecmp(n.c_str() + l - 4, ".prg") == 0);
+        if (isPrg) {
+            n = n.substr(0, l - 4);
+        }
+        bool match = (*name == '\0') ? isPrg : cbmMatch(name, n.c_str());
+        if (match && (found.empty() || found > e->d_name)) {
+            found = e->d_name;
+        }
+    }
+    closedir(d);
+    if (found.empty()) {
+        return ENOENT;
+    }
+    path = folder + "/" + found;
+    return 0;
+}
+
+/**
+ * @brief extract a PRG from a .d64 image
+ * @param path path to the image
+ * @param name the CBM filename (may have wildcards), empty for the first file
+ * @param buf on return, the file (to be freed with free())
+ * @param size on return, the file size
+ * @return 0 on success, or errno
+ */
+int CKernalTrap::loadFromD64(const char *path, const char *name, uint8_t **buf,
+                             uint32_t *size) {
+    uint8_t *img;
+    uint32_t imgSize;
+    int res = CBuffer::fromFile(path, &img, &imgSize);
+    if (res != 0) {
+        return res;
+    }
+
+    // walk the directory chain, starting from 18/1
+    int track = 18;
+    int sector = 1;
+    int fileTrack = 0;
+    int fileSector = 0;
+    for (int guard = 0; track != 0 && guard < 32 && !fileTrack; guard++) {
+        int off = d64SectorOffset(track, sector);
+        if (off < 0 || off + 256 > (int)imgSize) {
+            break;
+        }
+        uint8_t *s = &img[off];
+        for (int i = 0; i < 8; i++) {
+            uint8_t *entry = &s[i * 32];
+            if ((entry[2] & 7) != 2) {
+                // not a PRG (or deleted)
+                continue;
+            }
+            char n[17];
+            int l = 0;
+            while (l < 16 && entry[5 + l] != 0xa0) {
+                n[l] = (char)tolower(entry[5 + l] & 0x7f);
+                l++;
+            }
+            n[l] = '\0';
+            if (*name == '\0' || cbmMatch(name, n)) {
+                fileTrack = entry[3];
+                fileSector = entry[4];
+                break;
+            }
+        }
+        track = s[0];
+        sector = s[1];
+    }
+    if (!fileTrack) {
+        free(img);
+        return ENOENT;
+    }
+
+    // follow the file chain
+    *buf = (uint8_t *)calloc(1, MEMORY_SIZE + 2);
+    *size = 0;
+    track = fileTrack;
+    sector = fileSector;
+    for (int guard = 0; track != 0 && guard < 800; guard++) {
+        int off = d64SectorOffset(track, sector);
+        if (off < 0 || off + 256 > (int)imgSize) {
+            break;
+        }
+        uint8_t *s = &img[off];
+        int used = (s[0] == 0) ? s[1] - 1 : 254;
+        if (used > 0 && *size + used <= MEMORY_SIZE + 2) {
+            memcpy(*buf + *size, &s[2], used);
+            *size += used;
+        }
+        track = s[0];
+        sector = s[1];
+    }
+    free(img);
+    return 0;
+}
+
+/**
+ * @brief handle LOAD
+ * @return 0 on success, a kernal error code, or KERNAL_TRAP_PASSTHROUGH
+ */
+int CKernalTrap::trapLoad() {
+    uint8_t device;
+    _mem->readByte(ZEROPAGE_KERNAL_DEVICE, &device, true);
+    if (!isAttached(device)) {
+        return KERNAL_TRAP_PASSTHROUGH;
+    }
+    char name[64];
+    filename(name, sizeof(name));
+    if (*name == '\0' && device == 8) {
+        return KERNAL_ERROR_MISSING_FILENAME;
+    }
+
+    // get the file
+    std::string &src = _source[sourceIndex(device)];
+    uint8_t *buf = nullptr;
+    uint32_t size = 0;
+    int res;
+    struct stat st;
+    size_t l = src.size();
+    if (stat(src.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        std::string path;
+        res = findInFolder(src, name, path);
+        if (res == 0) {
+            res = CBuffer::fromFile(path.c_str(), &buf, &size);
+        }
+    } else if (l > 4 && strcasecmp(src.c_str() + l - 4, ".d64") == 0) {
+        res = loadFromD64(src.c_str(), name, &buf, &size);
+    } else {
+        // a single file, whatever the name
+        res = CBuffer::fromFile(src.c_str(), &buf, &size);
+    }
+    if (res != 0 || size < 2) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "LOAD \"%s\",%d: not found",
+                    name, device);
+        SAFE_FREE(buf)
+        return KERNAL_ERROR_FILE_NOT_FOUND;
+    }
+
+    // secondary address 0 loads at the address passed to LOAD (X/Y), either
+    // at the one in the file
+    uint8_t sa;
+    uint8_t verify;
+    uint16_t address;
+    _mem->readByte(ZEROPAGE_KERNAL_SA, &sa, true);
+    _mem->readByte(ZEROPAGE_KERNAL_VERIFY, &verify, true);
+    if (sa == 0) {
+        _mem->readWord(ZEROPAGE_KERNAL_LOAD_START, &address, true);
+    } else {
+        address = buf[0] | (buf[1] << 8);
+    }
+    size -= 2;
+    if (address + size > MEMORY_SIZE) {
+        size = MEMORY_SIZE - address;
+    }
+    uint8_t status = 0x40;
+    if (verify) {
+        uint8_t *mem = _mem->raw();
+        if (memcmp(&mem[address], &buf[2], size) != 0) {
+            // verify error
+            status |= 0x10;
+        }
+    } else {
+        _mem->writeBytes(address, &buf[2], size, true);
+    }
+    free(buf);
+
+    // end address, returned in X/Y too
+    uint16_t end = address + size;
+    _mem->writeWord(ZEROPAGE_KERNAL_END, end, true);
+    _mem->writeByte(ZEROPAGE_KERNAL_STATUS, status, true);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "%s \"%s\",%d,%d: start=$%04x, end=$%04x",
+                verify ? "VERIFY" : "LOAD", name, device, sa, address, end);
+    return 0;
+}
+
+/**
+ * @brief handle SAVE (to folders only)
+ * @return 0 on success, a kernal error code, or KERNAL_TRAP_PASSTHROUGH
+ */
+int CKernalTrap::trapSave() {
+    uint8_t device;
+    _mem->readByte(ZEROPAGE_KERNAL_DEVICE, &device, true);
+    if (!isAttached(device)) {
+        return KERNAL_TRAP_PASSTHROUGH;
+    }
+    char name[64];
+    filename(name, sizeof(name));
+    if (*name == '\0' || strpbrk(name, "*?/")) {
+        return KERNAL_ERROR_MISSING_FILENAME;
+    }
+    std::string &src = _source[sourceIndex(device)];
+    struct stat st;
+    if (stat(src.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "SAVE is supported on folders only!");
+        return KERNAL_ERROR_DEVICE_NOT_PRESENT;
+    }
+
+    // start in $c1, end (+1) in $ae
+    uint16_t start;
+    uint16_t end;
+    _mem->readWord(ZEROPAGE_KERNAL_SAVE_START, &start, true);
+    _mem->readWord(ZEROPAGE_KERNAL_END, &end, true);
+    uint32_t size = end > start ? end - start : 0;
+    uint8_t *buf = (uint8_t *)calloc(1, size + 2);
+    buf[0] = start & 0xff;
+    buf[1] = start >> 8;
+    _mem->readBytes(start, &buf[2], size, size);
+    std::string path = src + "/" + name + ".prg";
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(errno),
+                     path.c_str());
+        free(buf);
+        return KERNAL_ERROR_DEVICE_NOT_PRESENT;
+    }
+    fwrite(buf, size + 2, 1, f);
+    fclose(f);
+    free(buf);
+    _mem->writeByte(ZEROPAGE_KERNAL_STATUS, 0, true);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "SAVE \"%s\",%d: start=$%04x, end=$%04x", name, device, start,
+                end);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include "CMemory.h"
+
+/**
+ * @brief the traps stubs live in the lower half of the I/O2 area (unused
+ * without cartridges)
+ */
+#define KERNAL_TRAP_START 0xdf00
+#define KERNAL_TRAP_END 0xdf7f
+
+/**
+ * @brief kernal vectors table (copied to $0314-$0333 by RESTOR), ILOAD and
+ * ISAVE entries
+ */
+#define KERNAL_VECTOR_ILOAD 0xfd4c
+#define KERNAL_VECTOR_ISAVE 0xfd4e
+
+/**
+ * @brief the ILOAD and ISAVE vectors in RAM, the kernal LOAD/SAVE jump through
+ * them
+ */
+#define KERNAL_RAM_VECTOR_ILOAD 0x0330
+#define KERNAL_RAM_VECTOR_ISAVE 0x0332
+
+/**
+ * @brief kernal zeropage locations used by LOAD/SAVE
+ * @see http://unusedino.de/ec64/technical/aay/c64/zpmain.htm
+ */
+#define ZEROPAGE_KERNAL_STATUS 0x90
+#define ZEROPAGE_KERNAL_VERIFY 0x93
+#define ZEROPAGE_KERNAL_END 0xae
+#define ZEROPAGE_KERNAL_FNLEN 0xb7
+#define ZEROPAGE_KERNAL_SA 0xb9
+#define ZEROPAGE_KERNAL_DEVICE 0xba
+#define ZEROPAGE_KERNAL_FNADDR 0xbb
+#define ZEROPAGE_KERNAL_SAVE_START 0xc1
+#define ZEROPAGE_KERNAL_LOAD_START 0xc3
+
+/**
+ * @brief kernal error codes
+ */
+#define KERNAL_ERROR_FILE_NOT_FOUND 4
+#define KERNAL_ERROR_DEVICE_NOT_PRESENT 5
+
+/**
+ * @brief traps the kernal LOAD/SAVE vectors, so that accesses to device 8
+ * (disk) and 1 (tape) are satisfied instantly from host files: a folder of
+ * .PRG files, a .D64 image or a single .PRG. other devices go to the kernal
+ * as usual.
+ *
+ * the ROMs are left untouched (and shared): the RAM vectors are redirected
+ * to the traps whenever RESTOR sets them to the kernal handlers.
+ */
+class CKernalTrap {
+  public:
+    /**
+     * @brief constructor
+     * @param mem the emulated memory
+     */
+    CKernalTrap(CMemory *mem);
+    ~CKernalTrap();
+
+    /**
+     * @brief attach a source to a device
+     * @param device 8 or 1
+     * @param path folder, .d64 image or .prg file
+     * @return 0 on success, or errno
+     */
+    int attach(int device, const char *path);
+
+    /**
+     * @brief check if something is attached to the device
+     * @param device the device
+     * @return bool
+     */
+    bool isAttached(int device);
+
+    /**
+     * @brief prepare the traps, to be called once the ROMs are loaded and
+     * before the kernal runs
+     * @return 0 on success, or errno
+     */
+    int install();
+
+    /**
+     * @brief to be called on cpu writes to KERNAL_RAM_VECTOR_ILOAD-ISAVE+1:
+     * once RESTOR (at reset, and on RUNSTOP+RESTORE) has set a vector to the
+     * kernal handler, it's redirected to the trap (programs setting their own
+     * handlers are left alone)
+     */
+    void checkVectors();
+
+    /**
+     * @brief read from the trap area, the cpu executes the stubs from here
+     * @param address the address, KERNAL_TRAP_START-KERNAL_TRAP_END
+     * @param bt on return, the byte
+     */
+    void read(uint16_t address, uint8_t *bt);
+
+    /**
+     * @brief write to the trap area, which triggers the traps
+     * @param address the address, KERNAL_TRAP_START-KERNAL_TRAP_END
+     * @param bt the byte
+     */
+    void write(uint16_t address, uint8_t bt);
+
+  private:
+    CMemory *_mem = nullptr;
+    std::string _source[2];
+    uint16_t _iload = 0;
+    uint16_t _isave = 0;
+    uint8_t _stub[KERNAL_TRAP_END - KERNAL_TRAP_START + 1] = {0};
+
+    int sourceIndex(int device);
+    void filename(char *name, int size);
+    int findInFolder(const std::string &folder, const char *name,
+                     std::string &path);
+    int loadFromD64(const char *path, const char *name, uint8_t **buf,
+                    uint32_t *size);
+    int trapLoad();
+    int trapSave();
+};
@@ -8,20 +8,121 @@
 #include <SDL.h>
 #include <CBuffer.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mutex>
 #include "bitutils.h"
+#ifdef VC64_EMBED_ROMS
+// generated by cmake, see VC64_EMBED_ROMS in CMakeLists.txt
+#include "embedded_roms.h"
+static_assert(sizeof(embeddedKernalRom) >= MEMORY_KERNAL_SIZE &&
+                  sizeof(embeddedBasicRom) >= MEMORY_BASIC_SIZE &&
+                  sizeof(embeddedCharsetRom) >= MEMORY_CHARSET_SIZE,
+              "embedded ROMs too small!");
+#endif
+
+/**
+ * @brief a ROM image, shared by all the instances in the process
+ */
+typedef struct _romImage {
+    const char *name;
+    uint32_t size;       // expected size
+    const uint8_t *data; // read only
+    uint32_t mappedSize; // 0 if not mmap'd
+} RomImage;
+
+#define ROM_KERNAL 0
+#define ROM_BASIC 1
+#define ROM_CHARSET 2
+static RomImage sharedRoms[] = {
+    {"kernal", MEMORY_KERNAL_SIZE, nullptr, 0},
+    {"basic", MEMORY_BASIC_SIZE, nullptr, 0},
+    {"charset", MEMORY_CHARSET_SIZE, nullptr, 0},
+};
+static int sharedRomsRefs = 0;
+static std::mutex sharedRomsLock;
+
+/**
+ * @brief map a ROM file read only, or load it if mmap() is not possible
+ * @param path path to the file
+ * @param rom the ROM image
+ * @return 0 on success, or errno
+ */
+static int mapRom(const char *path, RomImage *rom) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    struct stat st;
+    int res = fstat(fd, &st) == 0 ? 0 : errno;
+    if (res == 0 && st.st_size < rom->size) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "%s: ROM too small, size=0x%x, expected=0x%x", path,
+                     (uint32_t)st.st_size, rom->size);
+        res = EINVAL;
+    }
+    if (res == 0) {
+        void *p = mmap(nullptr, rom->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            rom->data = (uint8_t *)p;
+            rom->mappedSize = rom->size;
+        } else {
+            uint8_t *buf;
+            uint32_t size;
+            res = CBuffer::fromFile(path, &buf, &size);
+            rom->data = buf;
+        }
+    }
+    close(fd);
+    return res;
+}
+
+/**
+ * @brief unmap/free the shared ROMs
+ */
+static void unmapRoms() {
+    for (int i = 0; i < 3; i++) {
+        RomImage *rom = &sharedRoms[i];
+#ifndef VC64_EMBED_ROMS
+        if (rom->mappedSize) {
+            munmap((void *)rom->data, rom->mappedSize);
+            rom->mappedSize = 0;
+        } else if (rom->data) {
+            free((void *)rom->data);
+        }
+#endif
+        rom->data = nullptr;
+    }
+}
 
 CMemory::CMemory(CPLA *pla) {
-    // allocate main memory and the shadows
+    // allocate main memory, ROMs are loaded by init()
     _mem = (uint8_t *)calloc(1, MEMORY_SIZE);
-    _kernalRom = (uint8_t *)calloc(1, MEMORY_KERNAL_SIZE);
-    _basicRom = (uint8_t *)calloc(1, MEMORY_BASIC_SIZE);
-    _charRom = (uint8_t *)calloc(1, MEMORY_CHARSET_SIZE);
-
     _pla = pla;
 }
 
-CMemory::~CMemory(){SAFE_FREE(_mem) SAFE_FREE(_charRom) SAFE_FREE(_basicRom)
-                        SAFE_FREE(_kernalRom)}
+CMemory::~CMemory() {
+    SAFE_FREE(_mem)
+    if (_charRomOwned) {
+        free((void *)_charRom);
+    }
+    if (_basicRomOwned) {
+        free((void *)_basicRom);
+    }
+    if (_kernalRomOwned) {
+        free((void *)_kernalRom);
+    }
+    if (_romsShared) {
+        // release the shared ROMs
+        std::lock_guard<std::mutex> lock(sharedRomsLock);
+        sharedRomsRefs--;
+        if (sharedRomsRefs == 0) {
+            unmapRoms();
+        }
+    }
+}
 
 uint8_t CMemory::readByte(uint32_t address, uint8_t *b, bool raw) {
     if (!b) {
@@ -110,6 +211,49 @@ int CMemory::writeWord(uint32_t address, uint16_t w, bool raw) {
     return 0;
 }
 
+/**
+ * @brief get the source of a span of reads, split at bank boundaries
+ * @param address start address
+ * @param size on input the requested size, on return the size of the span
+ * (up to the end of the bank)
+ * @return pointer to the RAM or the mapped ROM
+ */
+const uint8_t *CMemory::readSpan(uint32_t address, uint32_t *size) {
+    // banks: $0000-$9fff ram, $a000-$bfff basic, $c000-$cfff ram,
+    // $d000-$dfff charset/io, $e000-$ffff kernal
+    const uint8_t *rom = nullptr;
+    uint32_t base = 0;
+    uint32_t end;
+    if (address < MEMORY_BASIC_ADDRESS) {
+        end = MEMORY_BASIC_ADDRESS;
+    } else if (address < MEMORY_BASIC_ADDRESS + MEMORY_BASIC_SIZE) {
+        end = MEMORY_BASIC_ADDRESS + MEMORY_BASIC_SIZE;
+        if (_pla->mapAddressToType(address) == PLA_MAP_BASIC_ROM) {
+            rom = _basicRom;
+            base = MEMORY_BASIC_ADDRESS;
+        }
+    } else if (address < MEMORY_CHARSET_ADDRESS) {
+        end = MEMORY_CHARSET_ADDRESS;
+    } else if (address < MEMORY_CHARSET_ADDRESS + MEMORY_CHARSET_SIZE) {
+        // i/o is not handled here, as in readByte()
+        end = MEMORY_CHARSET_ADDRESS + MEMORY_CHARSET_SIZE;
+        if (_pla->mapAddressToType(address) == PLA_MAP_CHARSET_ROM) {
+            rom = _charRom;
+            base = MEMORY_CHARSET_ADDRESS;
+        }
+    } else {
+        end = MEMORY_SIZE;
+        if (_pla->mapAddressToType(address) == PLA_MAP_KERNAL_ROM) {
+            rom = _kernalRom;
+            base = MEMORY_KERNAL_ADDRESS;
+        }
+    }
+    if (address + *size > end) {
+        *size = end - address;
+    }
+    return rom ? rom + (address - base) : _mem + address;
+}
+
 int CMemory::readBytes(uint32_t address, uint8_t *b, uint32_t bufferSize,
                        uint32_t readSize, bool raw) {
     int res = 0;
@@ -119,75 +263,89 @@ int CMemory::readBytes(uint32_t address, uint8_t *b, uint32_t bufferSize,
         s = bufferSize;
         res = EOVERFLOW;
     }
-    for (uint16_t i = 0; i < s; i++) {
-        uint8_t c;
-        readByte(address + i, &c, raw);
-        b[i] = c;
+
+    // copy contiguous spans, wrapping at 64k
+    address &= (MEMORY_SIZE - 1);
+    while (s) {
+        uint32_t span = s;
+        if (address + span > MEMORY_SIZE) {
+            span = MEMORY_SIZE - address;
+        }
+        const uint8_t *src = raw ? _mem + address : readSpan(address, &span);
+        memcpy(b, src, span);
+        b += span;
+        s -= span;
+        address = (address + span) & (MEMORY_SIZE - 1);
     }
     return res;
 }
 
 int CMemory::writeBytes(uint32_t address, uint8_t *b, uint32_t size, bool raw) {
-    for (uint32_t i = 0; i < size; i++) {
-        writeByte(address + i, b[i], raw);
+    // writes always go to ram, only $00/$01 (the cpu port) need handling.
+    // wraps at 64k
+    address &= (MEMORY_SIZE - 1);
+    while (size) {
+        if (address < 2) {
+            writeByte(address, *b);
+            address++;
+            b++;
+            size--;
+            continue;
+        }
+        uint32_t span = size;
+        if (address + span > MEMORY_SIZE) {
+            span = MEMORY_SIZE - address;
+        }
+        memcpy(_mem + address, b, span);
+        b += span;
+        size -= span;
+        address = (address + span) & (MEMORY_SIZE - 1);
     }
     return 0;
 }
 
 /**
- * @brief load bios files
+ * @brief load bios files, once per process: the first instance maps them and
+ * the others share the same (read only) pages
  * @return 0 on success, or errno
  */
 int CMemory::loadBios() {
-    char path[260];
-    char bios[] = "./bios";
-    bool ok = false;
-    int res = 0;
-    do {
-        // load kernal
-        snprintf(path, sizeof(path), "%s/kernal.bin", bios);
-        uint32_t kernalSize;
-        res = CBuffer::fromFile(path, &_kernalRom, &kernalSize);
-        if (res != 0) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
-                         path);
-            break;
-        }
-        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                    "loaded kernal ROM: %s, size=0x%0x", path, kernalSize);
-
-        // load charset
-        uint32_t charsetSize;
-        snprintf(path, sizeof(path), "%s/charset.bin", bios);
-        res = CBuffer::fromFile(path, &_charRom, &charsetSize);
-        if (res != 0) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
-                         path);
-            break;
-        }
-        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                    "loaded charset ROM: %s, size=0x%0x", path, charsetSize);
-
-        // load basic
-        uint32_t basicSize;
-        snprintf(path, sizeof(path), "%s/basic.bin", bios);
-        res = CBuffer::fromFile(path, &_basicRom, &basicSize);
-        if (res != 0) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
-                         path);
-            break;
+    if (_romsShared) {
+        // already there (i.e. reset)
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(sharedRomsLock);
+    if (sharedRomsRefs == 0) {
+#ifdef VC64_EMBED_ROMS
+        // built in the executable, no I/O at all
+        sharedRoms[ROM_KERNAL].data = embeddedKernalRom;
+        sharedRoms[ROM_BASIC].data = embeddedBasicRom;
+        sharedRoms[ROM_CHARSET].data = embeddedCharsetRom;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "using embedded ROMs");
+#else
+        char bios[] = "./bios";
+        for (int i = 0; i < 3; i++) {
+            char path[260];
+            snprintf(path, sizeof(path), "%s/%s.bin", bios, sharedRoms[i].name);
+            int res = mapRom(path, &sharedRoms[i]);
+            if (res != 0) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s",
+                             strerror(res), path);
+                unmapRoms();
+                return res;
+            }
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "loaded %s ROM: %s, size=0x%0x%s", sharedRoms[i].name,
+                        path, sharedRoms[i].size,
+                        sharedRoms[i].mappedSize ? " (mapped)" : "");
         }
-        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                    "loaded basic ROM: %s, size=0x%0x", path, basicSize);
-        ok = true;
-    } while (0);
-    if (!ok) {
-        SAFE_FREE(_charRom)
-        SAFE_FREE(_kernalRom)
-        SAFE_FREE(_basicRom)
-        return res;
+#endif
     }
-
+    sharedRomsRefs++;
+    _romsShared = true;
+    _kernalRom = sharedRoms[ROM_KERNAL].data;
+    _basicRom = sharedRoms[ROM_BASIC].data;
+    _charRom = sharedRoms[ROM_CHARSET].data;
     return 0;
 }
 
@@ -271,7 +429,58 @@ uint8_t *CMemory::raw(uint32_t *size) {
     return _mem;
 }
 
-uint8_t *CMemory::charset() { return _charRom; }
+const uint8_t *CMemory::charset() { return _charRom; }
+
+uint64_t CMemory::romsHash() {
+    // FNV-1a over the original images, whatever patched since
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 3; i++) {
+        const uint8_t *p = sharedRoms[i].data;
+        for (uint32_t j = 0; p && j < sharedRoms[i].size; j++) {
+            h ^= p[j];
+            h *= 0x100000001b3ULL;
+        }
+    }
+    return h;
+}
+
+/**
+ * @brief get a private (writable) copy of a shared ROM, done once
+ * @param rom the ROM pointer, replaced with the copy
+ * @param owned true if the ROM is already a private copy
+ * @param size size of the ROM
+ * @return the writable ROM
+ */
+uint8_t *CMemory::privateRom(const uint8_t **rom, bool *owned, uint32_t size) {
+    if (!*owned) {
+        uint8_t *copy = (uint8_t *)calloc(1, size);
+        memcpy(copy, *rom, size);
+        *rom = copy;
+        *owned = true;
+    }
+    return (uint8_t *)*rom;
+}
+
+int CMemory::patchRom(uint32_t address, const uint8_t *b, uint32_t size) {
+    uint8_t *rom;
+    if (address >= MEMORY_BASIC_ADDRESS &&
+        address + size <= MEMORY_BASIC_ADDRESS + MEMORY_BASIC_SIZE) {
+        rom = privateRom(&_basicRom, &_basicRomOwned, MEMORY_BASIC_SIZE) +
+              (address - MEMORY_BASIC_ADDRESS);
+    } else if (address >= MEMORY_KERNAL_ADDRESS &&
+               address + size <= MEMORY_KERNAL_ADDRESS + MEMORY_KERNAL_SIZE) {
+        rom = privateRom(&_kernalRom, &_kernalRomOwned, MEMORY_KERNAL_SIZE) +
+              (address - MEMORY_KERNAL_ADDRESS);
+    } else if (address >= MEMORY_CHARSET_ADDRESS &&
+               address + size <= MEMORY_CHARSET_ADDRESS + MEMORY_CHARSET_SIZE) {
+        rom = privateRom(&_charRom, &_charRomOwned, MEMORY_CHARSET_SIZE) +
+              (address - MEMORY_CHARSET_ADDRESS);
+    } else {
+        return EINVAL;
+    }
+    memcpy(rom, b, size);
+    return 0;
+}
 
 int CMemory::loadPrg(const char *path) {
     if (!path) {
@@ -49,14 +49,21 @@ class CMemory : public IMemory {
     uint8_t *_mem = nullptr;
 
     // for commodity, we keep the ROMS aliased there in separate buffers (which
-    // shadows the respective address in the global memory)
-    uint8_t *_charRom = nullptr;
-    uint8_t *_kernalRom = nullptr;
-    uint8_t *_basicRom = nullptr;
+    // shadows the respective address in the global memory). they're shared
+    // between all the instances (read only), until patched
+    const uint8_t *_charRom = nullptr;
+    const uint8_t *_kernalRom = nullptr;
+    const uint8_t *_basicRom = nullptr;
+    bool _romsShared = false;
+    bool _charRomOwned = false;
+    bool _kernalRomOwned = false;
+    bool _basicRomOwned = false;
 
     CPLA *_pla = nullptr;
 
     int loadBios();
+    uint8_t *privateRom(const uint8_t **rom, bool *owned, uint32_t size);
+    const uint8_t *readSpan(uint32_t address, uint32_t *size);
 
   public:
     uint8_t pageZero00();
@@ -94,7 +101,24 @@ class CMemory : public IMemory {
      * return the charset rom
      * @return the memory pointer
      */
-    uint8_t *charset();
+    const uint8_t *charset();
+
+    /**
+     * hash the ROMs (as loaded, patches are not considered)
+     * @return the hash
+     */
+    uint64_t romsHash();
+
+    /**
+     * patch the basic/kernal/charset ROM (i.e. to install traps). the ROM is
+     * copied first, so the other instances sharing it are not affected
+     * @param address the address, as mapped
+     * @param b the bytes to write
+     * @param size number of bytes
+     * @return 0 on success, or EINVAL if the range is not in a ROM
+     */
+    int patchRom(uint32_t address, const uint8_t *b, uint32_t size);
+
     CMemory(CPLA *pla);
     ~CMemory();
 };
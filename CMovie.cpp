@@ -0,0 +1,170 @@
+#include "CMovie.h"
+#include <SDL.h>
+#include <CBuffer.h>
+#include <errno.h>
+#include <string.h>
+
+CMovie::CMovie(CCIA1 *cia1) { _cia1 = cia1; }
+
+CMovie::~CMovie() { close(); }
+
+int CMovie::record(const char *path) {
+    close();
+    _file = fopen(path, "wb");
+    if (!_file) {
+        int res = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
+                     path);
+        return res;
+    }
+    fwrite(MOVIE_MAGIC, strlen(MOVIE_MAGIC), 1, _file);
+    fputc(MOVIE_VERSION, _file);
+    _lastEvent = 0;
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "recording input to %s", path);
+    return 0;
+}
+
+int CMovie::play(const char *path) {
+    close();
+    int res = CBuffer::fromFile(path, &_buf, &_size);
+    if (res != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "failed to load movie: %s (%d)", path, res);
+        return res;
+    }
+    size_t l = strlen(MOVIE_MAGIC);
+    if (_size <= l || memcmp(_buf, MOVIE_MAGIC, l) != 0 ||
+        _buf[l] != MOVIE_VERSION) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "invalid movie: %s", path);
+        SAFE_FREE(_buf)
+        return EINVAL;
+    }
+    _pos = l + 1;
+    _lastEvent = 0;
+    readNextEvent();
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "playing back input from %s",
+                path);
+    return 0;
+}
+
+void CMovie::close() {
+    if (_file) {
+        // the end marker holds the length of the run
+        writeEvent(MOVIE_OP_END);
+        fclose(_file);
+        _file = nullptr;
+    }
+    SAFE_FREE(_buf)
+    _nextEvent = -1;
+}
+
+bool CMovie::isPlaying() { return _buf != nullptr; }
+
+/**
+ * @brief append an event, stamped with the current cycle
+ * @param op one of the MOVIE_OP
+ * @param data optional payload
+ * @param size payload size
+ */
+void CMovie::writeEvent(uint8_t op, const uint8_t *data, int size) {
+    if (!_file) {
+        return;
+    }
+    // cycles since the previous event, LEB128
+    uint64_t delta = (uint64_t)(_now - _lastEvent);
+    _lastEvent = _now;
+    do {
+        uint8_t b = delta & 0x7f;
+        delta >>= 7;
+        if (delta) {
+            b |= 0x80;
+        }
+        fputc(b, _file);
+    } while (delta);
+    fputc(op, _file);
+    if (size) {
+        fwrite(data, size, 1, _file);
+    }
+}
+
+/**
+ * @brief decode the timestamp of the next event
+ * @return false if the movie is over
+ */
+bool CMovie::readNextEvent() {
+    uint64_t delta = 0;
+    int shift = 0;
+    while (_pos < _size) {
+        uint8_t b = _buf[_pos++];
+        delta |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+        if (!(b & 0x80)) {
+            if (_pos >= _size || _buf[_pos] == MOVIE_OP_END) {
+                break;
+            }
+            _nextEvent = _lastEvent + delta;
+            return true;
+        }
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "movie ended, recorded run was %lld cycles",
+                (long long)(_lastEvent + delta));
+    SAFE_FREE(_buf)
+    _nextEvent = -1;
+    return false;
+}
+
+/**
+ * @brief apply the event at the current position
+ */
+void CMovie::replayEvent() {
+    uint8_t op = _buf[_pos++];
+    if (op < MOVIE_OP_INJECT) {
+        _cia1->setKeyState(op & 0x3f, (op & MOVIE_OP_KEY_PRESSED) != 0);
+    } else if (op == MOVIE_OP_INJECT) {
+        // same as CInput::injectKeyboardBuffer()
+        IMemory *mem = _cia1->_cpu->memory();
+        uint8_t len = _pos < _size ? _buf[_pos++] : 0;
+        if (len > 10 || _pos + len > _size) {
+            len = 0;
+        }
+        for (int i = 0; i < len; i++) {
+            mem->writeByte(631 + i, _buf[_pos++]);
+        }
+        mem->writeByte(198, len);
+    } else if (op == MOVIE_OP_RESTORE) {
+        _cia1->_cpu->nmi();
+    } else if (op == MOVIE_OP_JOY2HACK_OFF || op == MOVIE_OP_JOY2HACK_ON) {
+        _cia1->enableJoy2Hack(op == MOVIE_OP_JOY2HACK_ON);
+    }
+    _lastEvent = _nextEvent;
+}
+
+void CMovie::update(int64_t totalCycles) {
+    _now = totalCycles;
+    while (_buf && _now >= _nextEvent) {
+        replayEvent();
+        readNextEvent();
+    }
+}
+
+void CMovie::keyState(uint8_t scancode, bool pressed) {
+    writeEvent((scancode & 0x3f) | (pressed ? MOVIE_OP_KEY_PRESSED : 0));
+}
+
+void CMovie::keyboardBuffer(const char *chars) {
+    uint8_t data[11];
+    int len = strlen(chars);
+    if (len > 10) {
+        len = 10;
+    }
+    data[0] = len;
+    memcpy(&data[1], chars, len);
+    writeEvent(MOVIE_OP_INJECT, data, len + 1);
+}
+
+void CMovie::restore() { writeEvent(MOVIE_OP_RESTORE); }
+
+void CMovie::joy2Hack(bool enable) {
+    writeEvent(enable ? MOVIE_OP_JOY2HACK_ON : MOVIE_OP_JOY2HACK_OFF);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "CCIA1.h"
+#include <stdio.h>
+
+/**
+ * @brief movie file magic, followed by the format version
+ */
+#define MOVIE_MAGIC "VC64MOV"
+#define MOVIE_VERSION 1
+
+/**
+ * @brief movie events. each event is stored as the cycles elapsed since the
+ * previous one (LEB128), followed by the opcode. opcodes below
+ * MOVIE_OP_INJECT are key transitions: bit 6 = pressed, bits 0-5 = c64
+ * scancode
+ */
+#define MOVIE_OP_KEY_PRESSED 0x40
+#define MOVIE_OP_INJECT 0x80 // followed by length and PETSCII characters
+#define MOVIE_OP_RESTORE 0x81
+#define MOVIE_OP_JOY2HACK_OFF 0x82
+#define MOVIE_OP_JOY2HACK_ON 0x83
+#define MOVIE_OP_END 0xff
+
+/**
+ * @brief records every input transition reaching the emulated machine
+ * (keyboard matrix, joystick shortcuts, keyboard buffer injections, RESTORE),
+ * stamped with the emulated cycle, and plays it back. since the emulation only
+ * depends on its inputs, playing a movie from a cold boot with the same
+ * commandline reproduces the recorded run exactly
+ */
+class CMovie {
+  public:
+    /**
+     * @brief constructor
+     * @param cia1 pointer to the CIA1 instance, events are replayed there
+     */
+    CMovie(CCIA1 *cia1);
+    ~CMovie();
+
+    /**
+     * @brief start recording
+     * @param path path to the movie file
+     * @return 0 on success, or errno
+     */
+    int record(const char *path);
+
+    /**
+     * @brief start playing back, live input is ignored meanwhile
+     * @param path path to the movie file
+     * @return 0 on success, or errno
+     */
+    int play(const char *path);
+
+    /**
+     * @brief stop recording (finalizing the file) or playing back
+     */
+    void close();
+
+    /**
+     * @brief check if playing back
+     * @return bool
+     */
+    bool isPlaying();
+
+    /**
+     * @brief to be called after every cpu step: stamps the events recorded from
+     * now on, or replays the events which are due
+     * @param totalCycles total cpu cycles elapsed
+     */
+    void update(int64_t totalCycles);
+
+    /**
+     * @brief record a key transition
+     * @param scancode the c64 scancode
+     * @param pressed
+     */
+    void keyState(uint8_t scancode, bool pressed);
+
+    /**
+     * @brief record characters injected in the keyboard buffer
+     * @param chars the characters (max 10)
+     */
+    void keyboardBuffer(const char *chars);
+
+    /**
+     * @brief record a RESTORE (nmi)
+     */
+    void restore();
+
+    /**
+     * @brief record switching the joy2 hack on/off
+     * @param enable
+     */
+    void joy2Hack(bool enable);
+
+  private:
+    CCIA1 *_cia1 = nullptr;
+    FILE *_file = nullptr;
+    int64_t _now = 0;
+    int64_t _lastEvent = 0;
+
+    // playback, the whole movie is in memory
+    uint8_t *_buf = nullptr;
+    uint32_t _size = 0;
+    uint32_t _pos = 0;
+    int64_t _nextEvent = -1;
+
+    void writeEvent(uint8_t op, const uint8_t *data = nullptr, int size = 0);
+    bool readNextEvent();
+    void replayEvent();
+};
@@ -0,0 +1,193 @@
+#include "CProfiler.h"
+#include <SDL.h>
+#include <CBuffer.h>
+#include <algorithm>
+#include <errno.h>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief a row of the report
+ */
+typedef struct _profilerEntry {
+    uint32_t start;
+    uint32_t end; // inclusive
+    uint64_t cycles;
+    uint64_t hits;
+} ProfilerEntry;
+
+static bool byCycles(const ProfilerEntry &a, const ProfilerEntry &b) {
+    return a.cycles > b.cycles;
+}
+
+static bool byAddress(const ProfilerLabel &a, const ProfilerLabel &b) {
+    return a.address < b.address;
+}
+
+CProfiler::CProfiler() {
+    _cycles = (uint64_t *)calloc(0x10000, sizeof(uint64_t));
+    _hits = (uint32_t *)calloc(0x10000, sizeof(uint32_t));
+}
+
+CProfiler::~CProfiler() {
+    SAFE_FREE(_cycles)
+    SAFE_FREE(_hits)
+}
+
+int CProfiler::loadLabels(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        int res = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
+                     path);
+        return res;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        // al [C:]xxxx .label
+        char *p = line;
+        if (strncmp(p, "al ", 3) != 0) {
+            continue;
+        }
+        p += 3;
+        if (p[0] && p[1] == ':') {
+            // memspace
+            p += 2;
+        }
+        char *end;
+        unsigned long address = strtoul(p, &end, 16);
+        if (end == p || address > 0xffff) {
+            continue;
+        }
+        p = end + strspn(end, " \t");
+        if (*p == '.') {
+            p++;
+        }
+        p[strcspn(p, " \t\r\n")] = '\0';
+        if (*p == '\0') {
+            continue;
+        }
+        ProfilerLabel l;
+        l.address = (uint16_t)address;
+        l.name = p;
+        _labels.push_back(l);
+    }
+    fclose(f);
+    std::stable_sort(_labels.begin(), _labels.end(), byAddress);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "profiler: %d labels from %s",
+                (int)_labels.size(), path);
+    return 0;
+}
+
+/**
+ * @brief index of the nearest label at or below the address, or -1
+ */
+int CProfiler::labelIndex(uint16_t address) {
+    int lo = 0;
+    int hi = (int)_labels.size() - 1;
+    int found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (_labels[mid].address <= address) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief resolve an address as label[+offset], or as $xxxx
+ */
+std::string CProfiler::symbol(uint16_t address, bool withOffset) {
+    char tmp[300];
+    int idx = labelIndex(address);
+    if (idx < 0 || (!withOffset && _labels[idx].address != address)) {
+        snprintf(tmp, sizeof(tmp), "$%04x", address);
+    } else if (_labels[idx].address == address) {
+        snprintf(tmp, sizeof(tmp), "%s", _labels[idx].name.c_str());
+    } else {
+        snprintf(tmp, sizeof(tmp), "%s+%d", _labels[idx].name.c_str(),
+                 address - _labels[idx].address);
+    }
+    return tmp;
+}
+
+void CProfiler::report(int topN) {
+    if (_total == 0) {
+        return;
+    }
+
+    // group the instructions in ranges, each label starts one (the ones
+    // without a label before are grouped by page)
+    std::map<uint32_t, ProfilerEntry> ranges;
+    std::vector<ProfilerEntry> instructions;
+    for (uint32_t pc = 0; pc < 0x10000; pc++) {
+        if (_hits[pc] == 0) {
+            continue;
+        }
+        ProfilerEntry e = {pc, pc, _cycles[pc], _hits[pc]};
+        instructions.push_back(e);
+
+        int idx = labelIndex(pc);
+        uint32_t key;
+        uint32_t start;
+        uint32_t end;
+        if (idx >= 0) {
+            key = idx;
+            start = _labels[idx].address;
+            end = (idx + 1 < (int)_labels.size())
+                      ? _labels[idx + 1].address - 1
+                      : 0xffff;
+        } else {
+            key = 0x10000 | (pc >> 8);
+            start = pc & 0xff00;
+            end = start | 0xff;
+            if (!_labels.empty() && end >= _labels[0].address) {
+                end = _labels[0].address - 1;
+            }
+        }
+        std::map<uint32_t, ProfilerEntry>::iterator it = ranges.find(key);
+        if (it == ranges.end()) {
+            ProfilerEntry r = {start, end, 0, 0};
+            it = ranges.insert(std::make_pair(key, r)).first;
+        }
+        it->second.cycles += e.cycles;
+        it->second.hits += e.hits;
+    }
+    std::vector<ProfilerEntry> routines;
+    for (std::map<uint32_t, ProfilerEntry>::iterator it = ranges.begin();
+         it != ranges.end(); it++) {
+        routines.push_back(it->second);
+    }
+    std::stable_sort(routines.begin(), routines.end(), byCycles);
+    std::stable_sort(instructions.begin(), instructions.end(), byCycles);
+
+    printf("profiler: %llu cycles\n", (unsigned long long)_total);
+    printf("\n%-32s %-11s %12s %7s %12s\n", "routine", "range", "cycles", "%",
+           "instructions");
+    for (int i = 0; i < topN && i < (int)routines.size(); i++) {
+        ProfilerEntry &r = routines[i];
+        char range[16];
+        snprintf(range, sizeof(range), "$%04x-$%04x", r.start, r.end);
+        printf("%-32s %-11s %12llu %6.2f%% %12llu\n",
+               symbol(r.start, false).c_str(), range,
+               (unsigned long long)r.cycles, r.cycles * 100.0 / _total,
+               (unsigned long long)r.hits);
+    }
+    printf("\n%-32s %-11s %12s %7s %12s\n", "instruction", "address",
+           "cycles", "%", "executed");
+    for (int i = 0; i < topN && i < (int)instructions.size(); i++) {
+        ProfilerEntry &e = instructions[i];
+        char address[16];
+        snprintf(address, sizeof(address), "$%04x", e.start);
+        printf("%-32s %-11s %12llu %6.2f%% %12llu\n",
+               symbol(e.start, true).c_str(), address,
+               (unsigned long long)e.cycles, e.cycles * 100.0 / _total,
+               (unsigned long long)e.hits);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief a symbol, from a label file
+ */
+typedef struct _profilerLabel {
+    uint16_t address;
+    std::string name;
+} ProfilerLabel;
+
+/**
+ * @brief counts instructions and cycles per program counter, and reports the
+ * hottest routines (address ranges starting at a label, or 256 bytes pages
+ * without labels) and instructions
+ */
+class CProfiler {
+  public:
+    CProfiler();
+    ~CProfiler();
+
+    /**
+     * @brief load a VICE label file (lines like "al C:080d .start")
+     * @param path path to the label file
+     * @return 0 on success, or errno
+     */
+    int loadLabels(const char *path);
+
+    /**
+     * @brief account an executed instruction, to be called after cpu->step()
+     * @param pc address of the instruction
+     * @param cycles cycles taken
+     */
+    inline void add(uint16_t pc, int cycles) {
+        _cycles[pc] += cycles;
+        _hits[pc]++;
+        _total += cycles;
+    }
+
+    /**
+     * @brief print the report to stdout
+     * @param topN number of entries to show, per section
+     */
+    void report(int topN);
+
+  private:
+    uint64_t *_cycles = nullptr;
+    uint32_t *_hits = nullptr;
+    uint64_t _total = 0;
+    std::vector<ProfilerLabel> _labels = {};
+
+    std::string symbol(uint16_t address, bool withOffset);
+    int labelIndex(uint16_t address);
+};
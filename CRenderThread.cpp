@@ -0,0 +1,83 @@
+#include "CRenderThread.h"
+#include <CBuffer.h>
+#include <errno.h>
+#include <stdlib.h>
+
+CRenderThread::CRenderThread(int vicModel, CMOS65xx *cpu, CCIA2 *cia2,
+                             CPLA *pla)
+    : _head(0), _tail(0), _running(false) {
+    _renderer = CVICII::create(vicModel, cpu, cia2, pla);
+
+    // collisions are detected by the emulated vic
+    _renderer->setCollisionHandling(false, false);
+    _queue = (VicLineState *)calloc(RENDER_THREAD_QUEUE_SIZE,
+                                    sizeof(VicLineState));
+}
+
+CRenderThread::~CRenderThread() {
+    if (_thread) {
+        _running = false;
+        SDL_WaitThread(_thread, nullptr);
+    }
+    SAFE_FREE(_queue)
+    SAFE_DELETE(_renderer)
+}
+
+int CRenderThread::start() {
+    if (!_queue) {
+        return ENOMEM;
+    }
+    _running = true;
+    _thread = SDL_CreateThread(threadProc, "render", this);
+    if (!_thread) {
+        _running = false;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateThread(): %s",
+                     SDL_GetError());
+        return ECANCELED;
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "render thread started");
+    return 0;
+}
+
+CVICII *CRenderThread::renderer() { return _renderer; }
+
+void CRenderThread::push(const VicLineState *state) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    while (head - _tail.load(std::memory_order_acquire) >=
+           RENDER_THREAD_QUEUE_SIZE) {
+        // full, the render thread is behind
+        SDL_Delay(0);
+    }
+    _queue[head & (RENDER_THREAD_QUEUE_SIZE - 1)] = *state;
+    _head.store(head + 1, std::memory_order_release);
+}
+
+void CRenderThread::flush() {
+    while (_tail.load(std::memory_order_acquire) !=
+           _head.load(std::memory_order_relaxed)) {
+        SDL_Delay(0);
+    }
+}
+
+int CRenderThread::threadProc(void *thisPtr) {
+    CRenderThread *self = (CRenderThread *)thisPtr;
+    self->run();
+    return 0;
+}
+
+/**
+ * @brief draw the queued lines until stopped
+ */
+void CRenderThread::run() {
+    while (_running) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            // nothing to draw
+            SDL_Delay(1);
+            continue;
+        }
+        _renderer->drawLineState(
+            &_queue[tail & (RENDER_THREAD_QUEUE_SIZE - 1)]);
+        _tail.store(tail + 1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "CVICII.h"
+#include <SDL.h>
+#include <atomic>
+
+/**
+ * @brief lines queued to the render thread (power of 2, a bit more than a
+ * frame)
+ */
+#define RENDER_THREAD_QUEUE_SIZE 512
+
+/**
+ * @brief draws the vic lines on a separate thread. the emulated vic pushes
+ * the state of each line (registers and fetched memory), a renderer owned by
+ * the thread draws it into the display framebuffer
+ */
+class CRenderThread {
+  public:
+    /**
+     * @brief constructor
+     * @param vicModel the vic model (VIC_MODEL_*), as the emulated vic
+     * @param cpu the cpu
+     * @param cia2 the cia2
+     * @param pla the pla
+     */
+    CRenderThread(int vicModel, CMOS65xx *cpu, CCIA2 *cia2, CPLA *pla);
+    ~CRenderThread();
+
+    /**
+     * @brief start the thread
+     * @return 0 on success, or errno
+     */
+    int start();
+
+    /**
+     * @brief the renderer drawing the lines, to attach the display to
+     */
+    CVICII *renderer();
+
+    /**
+     * @brief queue a line, waits if the queue is full
+     * @param state the line state
+     */
+    void push(const VicLineState *state);
+
+    /**
+     * @brief wait until all the lines queued are drawn
+     */
+    void flush();
+
+  private:
+    CVICII *_renderer = nullptr;
+    SDL_Thread *_thread = nullptr;
+    VicLineState *_queue = nullptr;
+    std::atomic<uint32_t> _head;  // written by the emulation thread
+    std::atomic<uint32_t> _tail;  // written by the render thread
+    std::atomic<bool> _running;
+
+    static int threadProc(void *thisPtr);
+    void run();
+};
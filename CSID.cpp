@@ -3,15 +3,71 @@
 //
 
 #include "CSID.h"
+#include <stdlib.h>
+#include <CBuffer.h>
 
 CSID::CSID(CMOS65xx *cpu) {
     _cpu = cpu;
+    _samples = (int16_t *)calloc(1, SID_SAMPLE_BUFFER_SIZE * sizeof(int16_t));
 }
 
-CSID::~CSID() {
+CSID::~CSID() { SAFE_FREE(_samples) }
 
+/**
+ * @brief compute the current output level
+ * @todo voices and filter are not emulated yet, so the output is just the
+ * master volume DC level (which is what 4-bit digis play through anyway)
+ * @return the sample
+ */
+int16_t CSID::output() {
+    // $d418, bits 0-3 = master volume
+    return (int16_t)((_regs[0x18] & 0xf) << 10);
 }
 
-int CSID::update(int cycleCount) {
+void CSID::read(uint16_t address, uint8_t *bt) {
+    switch (address & 0x1f) {
+    case 0x19:
+    case 0x1a:
+        // paddles, not connected
+        *bt = 0xff;
+        break;
+    case 0x1b:
+    case 0x1c:
+        // oscillator/envelope 3, not emulated yet
+        *bt = 0;
+        break;
+    default:
+        // write only
+        *bt = 0;
+        break;
+    }
+}
+
+void CSID::write(uint16_t address, uint8_t bt) { _regs[address & 0x1f] = bt; }
+
+int CSID::update(int64_t cycleCount) {
+    // one sample per elapsed cycle
+    int elapsed = (int)(cycleCount - _prevCycles);
+    _prevCycles = cycleCount;
+    if (elapsed <= 0) {
+        return 0;
+    }
+    int free = SID_SAMPLE_BUFFER_SIZE - _numSamples;
+    if (elapsed > free) {
+        // nobody is draining the buffer, drop
+        elapsed = free;
+    }
+    int16_t s = output();
+    for (int i = 0; i < elapsed; i++) {
+        _samples[_numSamples + i] = s;
+    }
+    _numSamples += elapsed;
     return 0;
 }
+
+int16_t *CSID::samples(int *count) {
+    *count = _numSamples;
+    return _samples;
+}
+
+void CSID::consumeSamples() { _numSamples = 0; }
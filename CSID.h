@@ -4,6 +4,19 @@
 #pragma once
 #include <CMOS65xx.h>
 
+/**
+ * registers
+ * https://www.c64-wiki.com/wiki/SID
+ */
+#define SID_REGISTERS_START 0xd400
+#define SID_REGISTERS_END 0xd7ff
+
+/**
+ * @brief the SID produces one sample per cpu cycle, this is how many
+ * samples (~130ms on PAL) are kept before the audio output drains them
+ */
+#define SID_SAMPLE_BUFFER_SIZE 0x20000
+
 /**
  * implements the SID 6581 audio chip
  */
@@ -12,13 +25,45 @@ class CSID {
     CSID(CMOS65xx *cpu);
     ~CSID();
 
+    /**
+     * @brief read a register (mirrored every 32 bytes in $d400-$d7ff)
+     * @param address the address
+     * @param bt on return, the value
+     */
+    void read(uint16_t address, uint8_t *bt);
+
+    /**
+     * @brief write a register (mirrored every 32 bytes in $d400-$d7ff)
+     * @param address the address
+     * @param bt the value
+     */
+    void write(uint16_t address, uint8_t bt);
+
     /**
      * update the internal state
      * @param current cycle count
      * @return additional cycles used
      */
-    int update(int cycleCount);
+    int update(int64_t cycleCount);
+
+    /**
+     * @brief get the samples produced so far, at the SID clock rate (one per
+     * cpu cycle)
+     * @param count on return, number of samples in the buffer
+     * @return the samples buffer
+     */
+    int16_t *samples(int *count);
+
+    /**
+     * @brief discard the samples in the buffer, once processed
+     */
+    void consumeSamples();
 
   private:
     CMOS65xx *_cpu;
+    int64_t _prevCycles = 0;
+    int16_t *_samples = nullptr;
+    int _numSamples = 0;
+    uint8_t _regs[0x20] = {0};
+    int16_t output();
 };
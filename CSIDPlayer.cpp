@@ -0,0 +1,284 @@
+#include "CSIDPlayer.h"
+#include <SDL.h>
+#include <CBuffer.h>
+#include <stdio.h>
+#include <string.h>
+#include "bitutils.h"
+
+/**
+ * @brief read a big endian word from the header
+ */
+static uint16_t beWord(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+CSIDPlayer::CSIDPlayer() {}
+
+CSIDPlayer::~CSIDPlayer() { SAFE_FREE(_buf) }
+
+bool CSIDPlayer::isSIDFile(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    char magic[4] = {0};
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    if (n != sizeof(magic)) {
+        return false;
+    }
+    return (memcmp(magic, "PSID", 4) == 0 || memcmp(magic, "RSID", 4) == 0);
+}
+
+int CSIDPlayer::load(const char *path, int song) {
+    uint32_t size;
+    int res = CBuffer::fromFile(path, &_buf, &size);
+    if (res != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "failed to load SID: %s (%d)", path, res);
+        return res;
+    }
+    if (size < SID_HEADER_V1_SIZE) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "invalid SID header: %s",
+                     path);
+        return EINVAL;
+    }
+
+    // header is big endian
+    _isRSID = (memcmp(_buf, "RSID", 4) == 0);
+    int version = beWord(&_buf[0x4]);
+    uint16_t dataOffset = beWord(&_buf[0x6]);
+    _loadAddress = beWord(&_buf[0x8]);
+    _initAddress = beWord(&_buf[0xa]);
+    _playAddress = beWord(&_buf[0xc]);
+    _songs = beWord(&_buf[0xe]);
+    int startSong = beWord(&_buf[0x10]);
+    _speed = ((uint32_t)beWord(&_buf[0x12]) << 16) | beWord(&_buf[0x14]);
+    if (version >= 2 && size >= 0x7c) {
+        _flags = beWord(&_buf[0x76]);
+        _startPage = _buf[0x78];
+        _pageLength = _buf[0x79];
+    }
+    if (dataOffset >= size) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "invalid SID data: %s",
+                     path);
+        return EINVAL;
+    }
+    _data = _buf + dataOffset;
+    _dataSize = size - dataOffset;
+    if (_loadAddress == 0) {
+        // load address is in the first 2 bytes of data, as in a .PRG
+        if (_dataSize < 2) {
+            return EINVAL;
+        }
+        _loadAddress = _data[0] | (_data[1] << 8);
+        _data += 2;
+        _dataSize -= 2;
+    }
+    if (_initAddress == 0) {
+        _initAddress = _loadAddress;
+    }
+    if (_loadAddress + _dataSize > MEMORY_SIZE) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SID data exceeds memory: %s", path);
+        return EINVAL;
+    }
+
+    _song = song > 0 ? song : startSong;
+    if (_song < 1 || _song > _songs) {
+        _song = 1;
+    }
+
+    // strings are not necessarily 0 terminated
+    char name[33] = {0};
+    char author[33] = {0};
+    char released[33] = {0};
+    memcpy(name, &_buf[0x16], 32);
+    memcpy(author, &_buf[0x36], 32);
+    memcpy(released, &_buf[0x56], 32);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "%s v%d: \"%s\" by %s (%s), song %d/%d, load=$%04x, "
+                "init=$%04x, play=$%04x, %s",
+                _isRSID ? "RSID" : "PSID", version, name, author, released,
+                _song, _songs, _loadAddress, _initAddress, _playAddress,
+                isCIATimed() ? "CIA" : "VBI");
+    return 0;
+}
+
+/**
+ * @brief check the speed flag for the current song
+ * @return true if the play routine is to be called from the CIA timer, false
+ * for a 50hz raster interrupt (VBI)
+ */
+bool CSIDPlayer::isCIATimed() {
+    // songs > 32 use the same bit as song 32
+    int bit = (_song > 32 ? 32 : _song) - 1;
+    return IS_BIT_SET(_speed, bit);
+}
+
+/**
+ * @brief check if a memory area overlaps with the tune
+ * @param address start of the area
+ * @param size size of the area
+ * @return bool
+ */
+bool CSIDPlayer::overlapsTune(uint16_t address, int size) {
+    uint32_t tuneEnd = _loadAddress + _dataSize;
+    return (address < tuneEnd && address + size > _loadAddress);
+}
+
+/**
+ * @brief assemble the driver
+ * @param base address the driver is going to be installed at
+ * @param drv on return, the driver code (64 bytes max)
+ * @return size of the driver
+ */
+int CSIDPlayer::buildDriver(uint16_t base, uint8_t *drv) {
+    int i = 0;
+    bool usePlay = (_playAddress != 0 && !_isRSID);
+    bool cia = isCIATimed();
+
+    // sei, lda #song, jsr init
+    drv[i++] = 0x78;
+    drv[i++] = 0xa9;
+    drv[i++] = (uint8_t)(_song - 1);
+    drv[i++] = 0x20;
+    drv[i++] = _initAddress & 0xff;
+    drv[i++] = _initAddress >> 8;
+    int irqPatch = 0;
+    if (usePlay) {
+        // point the kernal irq vector at $0314 to our handler
+        drv[i++] = 0xa9;
+        irqPatch = i;
+        drv[i++] = 0;
+        drv[i++] = 0x8d;
+        drv[i++] = 0x14;
+        drv[i++] = 0x03;
+        drv[i++] = 0xa9;
+        drv[i++] = 0;
+        drv[i++] = 0x8d;
+        drv[i++] = 0x15;
+        drv[i++] = 0x03;
+        if (!cia) {
+            // disable CIA1 interrupts and enable the raster interrupt
+            // lda #$7f, sta $dc0d, lda $dc0d
+            drv[i++] = 0xa9;
+            drv[i++] = 0x7f;
+            drv[i++] = 0x8d;
+            drv[i++] = 0x0d;
+            drv[i++] = 0xdc;
+            drv[i++] = 0xad;
+            drv[i++] = 0x0d;
+            drv[i++] = 0xdc;
+
+            // lda #$00, sta $d012, lda $d011, and #$7f, sta $d011
+            drv[i++] = 0xa9;
+            drv[i++] = 0x00;
+            drv[i++] = 0x8d;
+            drv[i++] = 0x12;
+            drv[i++] = 0xd0;
+            drv[i++] = 0xad;
+            drv[i++] = 0x11;
+            drv[i++] = 0xd0;
+            drv[i++] = 0x29;
+            drv[i++] = 0x7f;
+            drv[i++] = 0x8d;
+            drv[i++] = 0x11;
+            drv[i++] = 0xd0;
+
+            // lda #$01, sta $d01a
+            drv[i++] = 0xa9;
+            drv[i++] = 0x01;
+            drv[i++] = 0x8d;
+            drv[i++] = 0x1a;
+            drv[i++] = 0xd0;
+        }
+        // else, CIA1 timer A is already running at 60hz from the kernal
+    }
+
+    // cli, then loop forever
+    drv[i++] = 0x58;
+    uint16_t loop = base + i;
+    drv[i++] = 0x4c;
+    drv[i++] = loop & 0xff;
+    drv[i++] = loop >> 8;
+    if (!usePlay) {
+        // the tune installed its own interrupts
+        return i;
+    }
+
+    // the irq handler
+    uint16_t irq = base + i;
+    drv[irqPatch] = irq & 0xff;
+    drv[irqPatch + 5] = irq >> 8;
+    if (!cia) {
+        // acknowledge the raster interrupt: lda $d019, sta $d019
+        drv[i++] = 0xad;
+        drv[i++] = 0x19;
+        drv[i++] = 0xd0;
+        drv[i++] = 0x8d;
+        drv[i++] = 0x19;
+        drv[i++] = 0xd0;
+    }
+
+    // jsr play
+    drv[i++] = 0x20;
+    drv[i++] = _playAddress & 0xff;
+    drv[i++] = _playAddress >> 8;
+
+    // back to the kernal: $ea31 (standard handler, acks the CIA) or $ea81
+    // (just restore registers and rti)
+    uint16_t kernalIrq = cia ? 0xea31 : 0xea81;
+    drv[i++] = 0x4c;
+    drv[i++] = kernalIrq & 0xff;
+    drv[i++] = kernalIrq >> 8;
+    return i;
+}
+
+int CSIDPlayer::install(CMemory *mem, char *cmd, int cmdSize) {
+    if (!_data) {
+        return EINVAL;
+    }
+
+    // copy the tune in ram
+    int res = mem->writeBytes(_loadAddress, _data, _dataSize, true);
+    if (res != 0) {
+        return res;
+    }
+    if (_isRSID && (_flags & SID_FLAG_BASIC)) {
+        // this is a basic program, setup pointers and RUN it
+        uint16_t end = _loadAddress + _dataSize;
+        mem->writeWord(ZEROPAGE_BASIC_PROGRAM_START, _loadAddress, true);
+        mem->writeWord(ZEROPAGE_BASIC_VARTAB, end, true);
+        mem->writeWord(ZEROPAGE_BASIC_ARYTAB, end, true);
+        mem->writeWord(ZEROPAGE_BASIC_STREND, end, true);
+        snprintf(cmd, cmdSize, "RUN\r");
+        return 0;
+    }
+
+    // find a place for the driver: the cassette buffer, the free page the
+    // tune declares (v2+), or some usually free areas
+    uint8_t drv[64];
+    uint16_t candidates[] = {0x0334, 0, 0xc000, 0xcf00, 0x02a7};
+    if (_startPage != 0 && _startPage != 0xff && _pageLength != 0) {
+        candidates[1] = _startPage << 8;
+    }
+    uint16_t base = 0;
+    for (unsigned i = 0; i < sizeof(candidates) / sizeof(uint16_t); i++) {
+        if (candidates[i] != 0 && !overlapsTune(candidates[i], sizeof(drv))) {
+            base = candidates[i];
+            break;
+        }
+    }
+    if (base == 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "no free memory for the SID driver!");
+        return ENOMEM;
+    }
+    int size = buildDriver(base, drv);
+    mem->writeBytes(base, drv, size, true);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "SID driver installed at $%04x, size=%d", base, size);
+
+    // start it from basic
+    snprintf(cmd, cmdSize, "SYS%d\r", base);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include "CMemory.h"
+
+/**
+ * @brief size of the PSID v1 header, v2+ headers are 0x7c bytes
+ * @see https://www.hvsc.c64.org/download/C64Music/DOCUMENTS/SID_file_format.txt
+ */
+#define SID_HEADER_V1_SIZE 0x76
+
+/**
+ * @brief PSID v2+ flags: the RSID tune is a BASIC program to be RUN
+ */
+#define SID_FLAG_BASIC 2
+
+/**
+ * @brief plays PSID/RSID tunes: installs the tune data and a small driver in
+ * memory, the driver calls the init routine and then the play routine from
+ * a raster (VBI) or CIA timer interrupt. the driver is started through the
+ * keyboard buffer once BASIC is up, as for .PRG files
+ */
+class CSIDPlayer {
+  public:
+    CSIDPlayer();
+    ~CSIDPlayer();
+
+    /**
+     * @brief check if the file has a PSID/RSID header
+     * @param path path to the file
+     * @return bool
+     */
+    static bool isSIDFile(const char *path);
+
+    /**
+     * @brief load and parse a .sid file
+     * @param path path to the file
+     * @param song subtune to play (1-based), 0 for the default one
+     * @return 0 on success, or errno
+     */
+    int load(const char *path, int song = 0);
+
+    /**
+     * @brief install tune and driver in memory
+     * @param mem the emulated memory
+     * @param cmd on return, the command to be injected in the keyboard buffer
+     * to start playing (max 10 characters)
+     * @param cmdSize size of the cmd buffer
+     * @return 0 on success, or errno
+     */
+    int install(CMemory *mem, char *cmd, int cmdSize);
+
+  private:
+    uint8_t *_buf = nullptr;
+    uint8_t *_data = nullptr;
+    uint32_t _dataSize = 0;
+    bool _isRSID = false;
+    uint16_t _loadAddress = 0;
+    uint16_t _initAddress = 0;
+    uint16_t _playAddress = 0;
+    int _songs = 0;
+    int _song = 0;
+    uint32_t _speed = 0;
+    uint16_t _flags = 0;
+    uint8_t _startPage = 0;
+    uint8_t _pageLength = 0;
+
+    bool isCIATimed();
+    bool overlapsTune(uint16_t address, int size);
+    int buildDriver(uint16_t base, uint8_t *drv);
+};
@@ -0,0 +1,190 @@
+#include "CScaler.h"
+#include <CBuffer.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * @brief alpha of the framebuffer pixels (ARGB8888)
+ */
+#define SCALER_ALPHA 0xff000000
+
+/**
+ * @brief replicate each pixel factor times (2, 3 or 4)
+ * @param src source row
+ * @param dst destination row
+ * @param n source pixels
+ * @param factor the factor
+ */
+static void replicate(const uint32_t *src, uint32_t *dst, int n, int factor) {
+    int i = 0;
+#if defined(__SSE2__)
+    // 4 pixels abcd at a time
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i *d = (__m128i *)(dst + i * factor);
+        switch (factor) {
+        case 2:
+            _mm_storeu_si128(d, _mm_shuffle_epi32(v, 0x50));     // aabb
+            _mm_storeu_si128(d + 1, _mm_shuffle_epi32(v, 0xfa)); // ccdd
+            break;
+        case 3:
+            _mm_storeu_si128(d, _mm_shuffle_epi32(v, 0x40));     // aaab
+            _mm_storeu_si128(d + 1, _mm_shuffle_epi32(v, 0xa5)); // bbcc
+            _mm_storeu_si128(d + 2, _mm_shuffle_epi32(v, 0xfe)); // cddd
+            break;
+        default:
+            _mm_storeu_si128(d, _mm_shuffle_epi32(v, 0x00));
+            _mm_storeu_si128(d + 1, _mm_shuffle_epi32(v, 0x55));
+            _mm_storeu_si128(d + 2, _mm_shuffle_epi32(v, 0xaa));
+            _mm_storeu_si128(d + 3, _mm_shuffle_epi32(v, 0xff));
+            break;
+        }
+    }
+#elif defined(__ARM_NEON)
+    // interleaving stores of the same 4 pixels
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t v = vld1q_u32(src + i);
+        uint32_t *d = dst + i * factor;
+        switch (factor) {
+        case 2: {
+            uint32x4x2_t r = {{v, v}};
+            vst2q_u32(d, r);
+            break;
+        }
+        case 3: {
+            uint32x4x3_t r = {{v, v, v}};
+            vst3q_u32(d, r);
+            break;
+        }
+        default: {
+            uint32x4x4_t r = {{v, v, v, v}};
+            vst4q_u32(d, r);
+            break;
+        }
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        for (int j = 0; j < factor; j++) {
+            dst[i * factor + j] = src[i];
+        }
+    }
+}
+
+/**
+ * @brief copy a row at 75% brightness (keeping alpha)
+ * @param src source row
+ * @param dst destination row
+ * @param n pixels
+ */
+static void darken(const uint32_t *src, uint32_t *dst, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i half = _mm_set1_epi32(0x7f7f7f7f);
+    const __m128i quarter = _mm_set1_epi32(0x3f3f3f3f);
+    const __m128i alpha = _mm_set1_epi32((int)SCALER_ALPHA);
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i h = _mm_and_si128(_mm_srli_epi32(v, 1), half);
+        __m128i q = _mm_and_si128(_mm_srli_epi32(v, 2), quarter);
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_or_si128(_mm_add_epi32(h, q), alpha));
+    }
+#elif defined(__ARM_NEON)
+    const uint32x4_t half = vdupq_n_u32(0x7f7f7f7f);
+    const uint32x4_t quarter = vdupq_n_u32(0x3f3f3f3f);
+    const uint32x4_t alpha = vdupq_n_u32(SCALER_ALPHA);
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t v = vld1q_u32(src + i);
+        uint32x4_t h = vandq_u32(vshrq_n_u32(v, 1), half);
+        uint32x4_t q = vandq_u32(vshrq_n_u32(v, 2), quarter);
+        vst1q_u32(dst + i, vorrq_u32(vaddq_u32(h, q), alpha));
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t v = src[i];
+        dst[i] = (((v >> 1) & 0x7f7f7f7f) + ((v >> 2) & 0x3f3f3f3f)) |
+                 SCALER_ALPHA;
+    }
+}
+
+CScaler::CScaler(int factor, bool scanlines, bool aspect, int srcW,
+                 int srcH) {
+    _factor = factor;
+    _scanlines = scanlines;
+    _srcW = srcW;
+    _srcH = srcH;
+    _w = srcW * factor;
+    _h = srcH * factor;
+    if (aspect) {
+        // nearest column, sampled at the center of the scaled pixel
+        _w = (int)(_w * SCALER_PAL_ASPECT + 0.5);
+        _columns = (uint16_t *)calloc(_w, sizeof(uint16_t));
+        for (int x = 0; x < _w && _columns; x++) {
+            _columns[x] = (uint16_t)(((2 * x + 1) * srcW) / (2 * _w));
+        }
+    }
+}
+
+CScaler::~CScaler() { SAFE_FREE(_columns) }
+
+int CScaler::parse(const char *spec, int *factor, bool *scanlines,
+                   bool *aspect) {
+    *factor = spec[0] - '0';
+    *scanlines = false;
+    *aspect = false;
+    if (*factor < 2 || *factor > 4) {
+        return EINVAL;
+    }
+    for (const char *p = spec + 1; *p; p++) {
+        if (*p == 's') {
+            *scanlines = true;
+        } else if (*p == 'a') {
+            *aspect = true;
+        } else {
+            return EINVAL;
+        }
+    }
+    return 0;
+}
+
+int CScaler::width() { return _w; }
+
+int CScaler::height() { return _h; }
+
+/**
+ * @brief scale a row horizontally
+ */
+void CScaler::scaleRow(const uint32_t *src, uint32_t *dst) {
+    if (!_columns) {
+        replicate(src, dst, _srcW, _factor);
+        return;
+    }
+    for (int x = 0; x < _w; x++) {
+        dst[x] = src[_columns[x]];
+    }
+}
+
+void CScaler::scale(const uint32_t *src, int srcPitch, uint32_t *dst,
+                    int dstPitch) {
+    for (int y = 0; y < _srcH; y++) {
+        uint32_t *first = dst + (y * _factor * dstPitch);
+        scaleRow(src + (y * srcPitch), first);
+
+        // the other rows are copies of the first one
+        for (int r = 1; r < _factor; r++) {
+            uint32_t *row = first + (r * dstPitch);
+            if (_scanlines && r == _factor - 1) {
+                darken(first, row, _w);
+            } else {
+                memcpy(row, first, _w * sizeof(uint32_t));
+            }
+        }
+    }
+}
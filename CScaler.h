@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief PAL c64 pixel aspect ratio (pixels are a bit narrower than tall)
+ */
+#define SCALER_PAL_ASPECT 0.9365
+
+/**
+ * @brief integer software scaler for the ARGB framebuffer, with optional
+ * scanlines (the last row of each scaled line darkened) and PAL aspect
+ * correction (columns resampled to the PAL pixel aspect)
+ */
+class CScaler {
+  public:
+    /**
+     * @brief constructor
+     * @param factor scale factor, 2, 3 or 4
+     * @param scanlines darken the last row of each scaled line
+     * @param aspect correct the pixel aspect to PAL
+     * @param srcW source width
+     * @param srcH source height
+     */
+    CScaler(int factor, bool scanlines, bool aspect, int srcW, int srcH);
+    ~CScaler();
+
+    /**
+     * @brief parse a scaler specification, factor[s][a] (i.e. "3s")
+     * @param spec the specification
+     * @param factor on return, the factor
+     * @param scanlines on return, true if scanlines are requested
+     * @param aspect on return, true if aspect correction is requested
+     * @return 0 on success, or errno
+     */
+    static int parse(const char *spec, int *factor, bool *scanlines,
+                     bool *aspect);
+
+    /**
+     * @brief scale a frame
+     * @param src the source frame
+     * @param srcPitch source row length, in pixels
+     * @param dst the destination, at least width() * height() pixels
+     * @param dstPitch destination row length, in pixels
+     */
+    void scale(const uint32_t *src, int srcPitch, uint32_t *dst,
+               int dstPitch);
+
+    /**
+     * @brief scaled width
+     */
+    int width();
+
+    /**
+     * @brief scaled height
+     */
+    int height();
+
+  private:
+    int _factor = 2;
+    bool _scanlines = false;
+    int _srcW = 0;
+    int _srcH = 0;
+    int _w = 0;
+    int _h = 0;
+
+    // with aspect correction, the source column of each scaled column
+    uint16_t *_columns = nullptr;
+
+    void scaleRow(const uint32_t *src, uint32_t *dst);
+};
@@ -5,6 +5,7 @@
 #include "CVICII.h"
 #include <SDL.h>
 #include "CMemory.h"
+#include "CRenderThread.h"
 #include "bitutils.h"
 
 /**
@@ -30,8 +31,14 @@ void CVICII::initPalette() {
     _palette[15] = {0xbb, 0xbb, 0xbb};
 }
 
+/**
+ * @brief default blit callback, used when no display is attached (headless)
+ */
+static void nullBlitCallback(void *thisPtr, RgbStruct *rgb, int pos) {}
+
 CVICII::CVICII(CMOS65xx *cpu, CCIA2 *cia2, CPLA *pla) {
     _cpu = cpu;
+    _cb = nullBlitCallback;
     _cia2 = cia2;
     _pla = pla;
     initPalette();
@@ -45,22 +52,31 @@ CVICII::CVICII(CMOS65xx *cpu, CCIA2 *cia2, CPLA *pla) {
 void CVICII::setBlitCallback(void *display, BlitCallback cb) {
     _cb = cb;
     _displayObj = display;
+
+    // the new framebuffer must be drawn whole
+    memset(_lineSignatures, 0, sizeof(_lineSignatures));
 }
 
 /**
  * blit into the framebuffer
  * @param x x coordinate
- * @param y y coordinate
+ * @param y the rasterline
  * @param rgb rgb color
  */
 void CVICII::blit(int x, int y, RgbStruct *rgb) {
-    if (y >= VIC_PAL_SCREEN_H) {
+    // the framebuffer starts at the first vblank line
+    y -= _firstVblankLine;
+    if (y < 0 || y >= VIC_SCREEN_H) {
         // not visible, vblank
         return;
     }
+    if (x < _clipStart || x >= _clipEnd || _noPixels) {
+        // outside of the columns being rendered, or no pixels at all
+        return;
+    }
 
     // set the pixel
-    int pos = (y * VIC_PAL_SCREEN_W) + x;
+    int pos = (y * VIC_SCREEN_W) + x;
     _cb(_displayObj, rgb, pos);
 }
 
@@ -111,6 +127,18 @@ bool CVICII::isSpriteDrawingOnBorder(int x, int y) {
     return false;
 }
 
+void CVICII::setRenderingEnabled(bool enable) {
+    _renderingEnabled = enable;
+    memset(_lineSignatures, 0, sizeof(_lineSignatures));
+}
+
+void CVICII::setAccessCycle(int cycle) { _accessCycle = cycle; }
+
+void CVICII::setKeepUnchangedLines(bool enable) {
+    _keepUnchangedLines = enable;
+    memset(_lineSignatures, 0, sizeof(_lineSignatures));
+}
+
 void CVICII::setCollisionHandling(bool enableSpriteSprite,
                                   bool enableBackgroundSprite) {
     _sprSprHwCollisionEnabled = enableSpriteSprite;
@@ -130,6 +158,10 @@ void CVICII::checkSpriteSpriteCollision(int idx, int x, int y) {
         // disabled
         return;
     }
+    if (x < _clipStart || x >= _clipEnd) {
+        // checked by another render pass
+        return;
+    }
     Rect limits;
     getScreenLimits(&limits);
     for (int i = 0; i < 8; i++) {
@@ -182,6 +214,10 @@ void CVICII::checkSpriteBackgroundCollision(int x, int y) {
         // disabled
         return;
     }
+    if (x < _clipStart || x >= _clipEnd) {
+        // checked by another render pass
+        return;
+    }
     Rect limits;
     getScreenLimits(&limits);
     for (int i = 0; i < 8; i++) {
@@ -224,16 +260,11 @@ void CVICII::checkSpriteBackgroundCollision(int x, int y) {
 void CVICII::drawSpriteMulticolor(int rasterLine, int idx, int x, int row) {
     // SDL_Log("drawing multicolor sprite");
     int currentLine = rasterLine;
-    uint16_t addr = getSpriteDataAddress(idx);
-    bool checkSpriteSpriteColl = true;
 
     // draw sprite row
     for (int i = 0; i < 3; i++) {
-        // get sprite byte
-        uint8_t spByte;
-        uint16_t a = addr + (row * 3) + i;
-        // SDL_Log("reading multicolor sprite byte at $%x", a);
-        readVICByte(a, &spByte);
+        // get sprite byte (fetched by fetchLine())
+        uint8_t spByte = _fetch.sprite[idx][i];
 
         // read sprite data considering double-wide pixels
         for (int j = 0; j < 4; j++) {
@@ -289,16 +320,10 @@ void CVICII::drawSprite(int rasterLine, int idx, int x, int row) {
     // SDL_Log("drawing standard sprite");
     int currentLine = rasterLine;
 
-    // get sprite data address
-    uint16_t addr = getSpriteDataAddress(idx);
-
     // a sprite is 24x21, each row is 3 bytes
     for (int i = 0; i < 3; i++) {
-        // read sprite byte
-        uint8_t spByte;
-        uint16_t a = addr + (row * 3) + i;
-        // SDL_Log("reading sprite byte at $%x", a);
-        readVICByte(a, &spByte);
+        // read sprite byte (fetched by fetchLine())
+        uint8_t spByte = _fetch.sprite[idx][i];
 
         // draw sprite row bit by bit, take into account sprite X expansion
         // (2x multiplier)
@@ -419,21 +444,16 @@ void CVICII::drawCharacterMode(int rasterLine) {
             }
         }
 
-        // this is the display window line
-        int line = rasterLine - limits.firstVisibleLine;
-
         // this is the first display window column of the character to
         // display
         int x = limits.firstVisibleX + (c * 8);
+        if (x + _scrollX + 9 < _clipStart || x + _scrollX + 1 >= _clipEnd) {
+            // not in this render pass
+            continue;
+        }
 
-        // this is the first display window row of the character to display
-        int row = line / 8;
-
-        // this is the row of the character itself (8x8 character)
-        int charRow = line % 8;
-
-        // read screencode from screen memory
-        uint8_t screenCode = getScreenCode(c, row);
+        // read screencode from screen memory (fetched by fetchLine())
+        uint8_t screenCode = _fetch.screen[c];
 
         // background color
         RgbStruct backgroundRgb;
@@ -460,8 +480,8 @@ void CVICII::drawCharacterMode(int rasterLine) {
         }
 
         // read the character data and color
-        uint8_t data = getCharacterData(screenCode, charRow);
-        uint8_t charColor = getScreenColor(c, row);
+        uint8_t data = _fetch.data[c];
+        uint8_t charColor = _fetch.color[c];
         RgbStruct charRgb;
 
         // draw character bit by bit
@@ -583,26 +603,21 @@ void CVICII::drawBitmapMode(int rasterLine) {
     // draw bitmap
     int columns = 40;
     for (int c = 0; c < columns; c++) {
-        // this is the display window line
-        int line = rasterLine - limits.firstVisibleLine;
-
         // this is the first display window column for this this block
         int x = limits.firstVisibleX + (c * 8);
+        if (x + _scrollX + 9 < _clipStart || x + _scrollX + 1 >= _clipEnd) {
+            // not in this render pass
+            continue;
+        }
 
-        // this is the first displaywindow row for this block
-        int row = line / 8;
-
-        // this is the row of thebitmap block itself (8x8)
-        int bitmapRow = line % 8;
-
-        // read screencode for standard color
-        uint8_t screenCode = getScreenCode(c, row);
+        // read screencode for standard color (all fetched by fetchLine())
+        uint8_t screenCode = _fetch.screen[c];
 
         // read color memory for multicolor
-        uint8_t screenColor = getScreenColor(c, row);
+        uint8_t screenColor = _fetch.color[c];
 
         // read bitmap data
-        uint8_t bitmapData = getBitmapData(c, row, bitmapRow);
+        uint8_t bitmapData = _fetch.data[c];
 
         // draw bitmap
         if (_screenMode == VIC_SCREEN_MODE_BITMAP_STANDARD) {
@@ -683,7 +698,7 @@ void CVICII::drawBitmapMode(int rasterLine) {
 void CVICII::drawBorder(int rasterLine) {
     // draw border row through all screen
     RgbStruct borderRgb = _palette[getBorderColor() & 0xf];
-    for (int i = 0; i < VIC_PAL_SCREEN_W; i++) {
+    for (int i = _clipStart; i < _clipEnd; i++) {
         blit(i, rasterLine, &borderRgb);
     }
 }
@@ -720,79 +735,325 @@ void CVICII::getScreenLimits(Rect *limits) {
         limits->lastVisibleX = 334;
     }
 
-    limits->firstVblankLine = 15;
-    limits->lastVblankLine = 300;
+    limits->firstVblankLine = _firstVblankLine;
+    limits->lastVblankLine = _lastVblankLine;
 }
 
-int CVICII::update(long cycleCount) {
-    // check for badline
-    int currentRaster = getCurrentRasterLine();
-    bool isBadLine = ((currentRaster >= 0x30) && (currentRaster <= 0xf7)) &&
-                     ((currentRaster & 7) == (_scrollY & 7));
-    if (currentRaster == 0x30 && _scrollY == 0 && IS_BIT_SET(_regCR1, 4)) {
+/**
+ * @brief check for badline
+ * @param rasterLine the rasterline
+ * @return bool
+ */
+bool CVICII::isBadLine(int rasterLine) {
+    bool isBadLine = ((rasterLine >= 0x30) && (rasterLine <= 0xf7)) &&
+                     ((rasterLine & 7) == (_scrollY & 7));
+    if (rasterLine == 0x30 && _scrollY == 0 && IS_BIT_SET(_regCR1, 4)) {
         isBadLine = true;
     }
+    return isBadLine;
+}
 
-    // drawing a line always happens every 63 cycles on a PAL c64
-    int elapsedCycles = cycleCount - _prevCycles;
+/**
+ * @brief check if hardware collisions are detected at all
+ * @return bool
+ */
+bool CVICII::isCollisionDetectionEnabled() {
+    return _sprSprHwCollisionEnabled || _sprBckHwCollisionEnabled;
+}
 
-    if (isBadLine) {
-        if (elapsedCycles < VIC_PAL_CYCLES_PER_BADLINE) {
-            return 0;
+/**
+ * @brief read the memory a line is drawn from (the character row, and the
+ * sprite rows)
+ * @param line the rasterline
+ */
+void CVICII::fetchLine(int line) {
+    Rect limits;
+    getScreenLimits(&limits);
+    _fetch.window = _DEN && line >= limits.firstVisibleLine &&
+                    line <= limits.lastVisibleLine;
+    if (_fetch.window) {
+        int row = (line - limits.firstVisibleLine) / 8;
+        int dataRow = (line - limits.firstVisibleLine) % 8;
+        bool bitmap = (_screenMode == VIC_SCREEN_MODE_BITMAP_STANDARD ||
+                       _screenMode == VIC_SCREEN_MODE_BITMAP_MULTICOLOR);
+        for (int c = 0; c < 40; c++) {
+            uint8_t screenCode = getScreenCode(c, row);
+            _fetch.screen[c] = screenCode;
+            _fetch.color[c] = getScreenColor(c, row);
+            if (bitmap) {
+                _fetch.data[c] = getBitmapData(c, row, dataRow);
+            } else if (_screenMode ==
+                       VIC_SCREEN_MODE_EXTENDED_BACKGROUND_COLOR) {
+                // only 64 characters
+                _fetch.data[c] = getCharacterData(screenCode & 0x3f, dataRow);
+            } else {
+                _fetch.data[c] = getCharacterData(screenCode, dataRow);
+            }
         }
-    } else {
-        if (elapsedCycles < VIC_PAL_CYCLES_PER_LINE) {
+    }
+
+    // the sprites drawn, as in drawSprites()
+    _fetch.spriteMask = 0;
+    for (int idx = 0; idx < 8 && _DEN && _regSpriteEnabled; idx++) {
+        if (!isSpriteEnabled(idx)) {
+            continue;
+        }
+        int spriteY = getSpriteYCoordinate(idx);
+        int spriteH = isSpriteYExpanded(idx) ? 42 : 21;
+        if (line < spriteY || line >= spriteY + spriteH) {
+            continue;
+        }
+        int row = line - spriteY;
+        if (isSpriteYExpanded(idx)) {
+            row /= 2;
+        }
+        uint16_t addr = getSpriteDataAddress(idx) + (row * 3);
+        for (int i = 0; i < 3; i++) {
+            readVICByte(addr + i, &_fetch.sprite[idx][i]);
+        }
+        BIT_SET(_fetch.spriteMask, idx);
+    }
+}
+
+void CVICII::setFrameSkip(int skip, int every) {
+    _frameSkip = skip;
+    _frameSkipEvery = every;
+}
+
+bool CVICII::wasFrameSkipped() { return _lastFrameSkipped; }
+
+/**
+ * @brief the beam is back at line 0, decide if the frame is to be skipped
+ */
+void CVICII::startFrame() {
+    _lastFrameSkipped = _frameSkipped;
+    int n = (int)(_frames % _frameSkipEvery);
+    _frameSkipped = (_frameSkip > 0 && n >= _frameSkipEvery - _frameSkip);
+    _frames++;
+}
+
+/**
+ * @brief FNV-1a step
+ */
+static inline uint64_t hashByte(uint64_t h, uint8_t b) {
+    return (h ^ b) * 0x100000001b3ULL;
+}
+
+static uint64_t hashBytes(uint64_t h, const uint8_t *buf, int size) {
+    for (int i = 0; i < size; i++) {
+        h = hashByte(h, buf[i]);
+    }
+    return h;
+}
+
+/**
+ * @brief hash everything a rasterline is drawn from: registers, and the
+ * memory fetched by fetchLine()
+ * @return the signature, or 0 if the line must be drawn anyway (sprites on
+ * the line with hardware collisions enabled, which are detected while
+ * drawing)
+ */
+uint64_t CVICII::lineSignature() {
+    uint16_t bank = _cia2->vicMemoryAddress();
+    uint8_t regs[] = {(uint8_t)(_regCR1 & 0x7f),
+                      getCR2(),
+                      getMemoryPointers(),
+                      getBorderColor(),
+                      _regBC[0],
+                      _regBC[1],
+                      _regBC[2],
+                      _regBC[3],
+                      (uint8_t)_screenMode,
+                      (uint8_t)(bank >> 8),
+                      (uint8_t)(_screenAddress >> 8),
+                      (uint8_t)(_charsetAddress >> 8),
+                      (uint8_t)(_bitmapAddress >> 8)};
+    uint64_t h = hashBytes(0xcbf29ce484222325ULL, regs, sizeof(regs));
+    if (_fetch.window) {
+        h = hashBytes(h, _fetch.screen, sizeof(_fetch.screen));
+        h = hashBytes(h, _fetch.color, sizeof(_fetch.color));
+        h = hashBytes(h, _fetch.data, sizeof(_fetch.data));
+    }
+    if (_fetch.spriteMask) {
+        if (isCollisionDetectionEnabled()) {
+            // collisions must be detected again
             return 0;
         }
+        uint8_t spriteRegs[] = {_regMSBX,
+                                _regSpriteEnabled,
+                                _regSpriteYExpansion,
+                                _regSpriteXExpansion,
+                                _regSpriteMultiColor,
+                                _regSpriteDataPriority,
+                                _regMM[0],
+                                _regMM[1],
+                                _fetch.spriteMask};
+        h = hashBytes(h, spriteRegs, sizeof(spriteRegs));
+        h = hashBytes(h, _regM, sizeof(_regM));
+        h = hashBytes(h, _regMC, sizeof(_regMC));
+        for (int idx = 0; idx < 8; idx++) {
+            if (IS_BIT_SET(_fetch.spriteMask, idx)) {
+                h = hashBytes(h, _fetch.sprite[idx], 3);
+            }
+        }
+    }
+    return h ? h : 1;
+}
+
+/**
+ * @brief render the columns of a rasterline from where the last pass
+ * stopped, with the current registers
+ * @param rasterLine the rasterline index to draw
+ * @param toX first column not to render
+ */
+void CVICII::renderLine(int rasterLine, int toX) {
+    if (toX <= _renderedX) {
+        return;
     }
 
     // are we between in between upper and lower vblanks (= effectively
     // drawing the screen) ?
     Rect limits;
     getScreenLimits(&limits);
-    if (currentRaster >= limits.firstVblankLine &&
-        currentRaster <= limits.lastVblankLine) {
-        drawBorder(currentRaster - limits.firstVblankLine);
-
-        if (_screenMode == VIC_SCREEN_MODE_CHARACTER_STANDARD ||
-            _screenMode == VIC_SCREEN_MODE_CHARACTER_MULTICOLOR ||
-            _screenMode == VIC_SCREEN_MODE_EXTENDED_BACKGROUND_COLOR) {
-            // draw screen line in character mode
-            drawCharacterMode(currentRaster - limits.firstVblankLine);
-
-        } else if (_screenMode == VIC_SCREEN_MODE_BITMAP_STANDARD ||
-                   _screenMode == VIC_SCREEN_MODE_BITMAP_MULTICOLOR) {
-            // draw bitmap
-            drawBitmapMode(currentRaster - limits.firstVblankLine);
+    int y = rasterLine - limits.firstVblankLine; // the framebuffer row
+    bool draw = _renderingEnabled && rasterLine >= limits.firstVblankLine &&
+                rasterLine <= limits.lastVblankLine;
+    if (draw) {
+        fetchLine(rasterLine);
+    }
+    if (draw && _frameSkipped) {
+        // no pixels, but collisions are detected while drawing: the lines
+        // with sprites are drawn anyway (blit() drops the pixels)
+        draw = isCollisionDetectionEnabled() && _fetch.spriteMask;
+    } else if (draw && y < VIC_SCREEN_H && _keepUnchangedLines) {
+        if (_renderedX == 0 && toX == VIC_SCREEN_W) {
+            // the whole line in a single pass, the framebuffer row can be
+            // kept if it would be drawn as in the previous frame
+            uint64_t signature = lineSignature();
+            draw = (signature == 0 || signature != _lineSignatures[y]);
+            _lineSignatures[y] = signature;
+        } else {
+            // drawn in more passes, draw it in the next frame too
+            _lineSignatures[y] = 0;
         }
+    }
+    if (draw) {
+        // draw the whole line, blitting only the new columns
+        _clipStart = _renderedX;
+        _clipEnd = toX;
+        _noPixels = _frameSkipped;
+        if (_renderThread && !_frameSkipped) {
+            // the render thread draws the pixels, here the lines with
+            // sprites are drawn without, to detect collisions
+            VicLineState state;
+            saveLineState(&state, rasterLine);
+            _renderThread->push(&state);
+            _noPixels = true;
+            draw = isCollisionDetectionEnabled() && _fetch.spriteMask;
+        }
+        if (draw) {
+            drawLine(rasterLine);
+        }
+        _noPixels = false;
+    }
+    _renderedX = toX;
+}
 
-        // draw sprites
-        drawSprites(currentRaster - limits.firstVblankLine);
+/**
+ * @brief draw a line with the current registers and fetched memory
+ * @param line the rasterline
+ */
+void CVICII::drawLine(int line) {
+    if (!_noPixels) {
+        drawBorder(line);
     }
 
-    if (IS_BIT_SET(getInterruptEnabled(), 0)) {
-        // handle raster interrupt
-        if ((currentRaster - limits.firstVblankLine) ==
-            _rasterIrqLine - limits.firstVblankLine) {
-            // trigger irq if bits in $d01a is set for the raster
-            // interrupt
-            BIT_SET(_regInterrupt, 0);
-            _cpu->irq();
-        } else {
-            BIT_CLEAR(_regInterrupt, 0);
-        }
+    if (_screenMode == VIC_SCREEN_MODE_CHARACTER_STANDARD ||
+        _screenMode == VIC_SCREEN_MODE_CHARACTER_MULTICOLOR ||
+        _screenMode == VIC_SCREEN_MODE_EXTENDED_BACKGROUND_COLOR) {
+        // draw screen line in character mode
+        drawCharacterMode(line);
+
+    } else if (_screenMode == VIC_SCREEN_MODE_BITMAP_STANDARD ||
+               _screenMode == VIC_SCREEN_MODE_BITMAP_MULTICOLOR) {
+        // draw bitmap
+        drawBitmapMode(line);
     }
 
-    // update registers accordingly
-    currentRaster++;
-    setCurrentRasterLine(currentRaster);
+    // draw sprites
+    drawSprites(line);
+}
 
-    // return how many cycles drawing occupied
-    _prevCycles = cycleCount;
-    // return elapsedCycles;
-    return isBadLine ? VIC_PAL_CYCLES_PER_BADLINE : VIC_PAL_CYCLES_PER_LINE;
+/**
+ * @brief copy what the line is drawn from
+ * @param state on return, the line state
+ * @param line the rasterline
+ */
+void CVICII::saveLineState(VicLineState *state, int line) {
+    state->line = line;
+    state->fromX = _clipStart;
+    state->toX = _clipEnd;
+    state->screenMode = _screenMode;
+    state->scrollX = _scrollX;
+    state->CSEL = _CSEL;
+    state->RSEL = _RSEL;
+    state->DEN = _DEN;
+    state->regBorderColor = _regBorderColor;
+    memcpy(state->regBC, _regBC, sizeof(_regBC));
+    memcpy(state->regM, _regM, sizeof(_regM));
+    state->regMSBX = _regMSBX;
+    state->regSpriteEnabled = _regSpriteEnabled;
+    state->regSpriteYExpansion = _regSpriteYExpansion;
+    state->regSpriteXExpansion = _regSpriteXExpansion;
+    state->regSpriteMultiColor = _regSpriteMultiColor;
+    memcpy(state->regMM, _regMM, sizeof(_regMM));
+    memcpy(state->regMC, _regMC, sizeof(_regMC));
+    state->fetch = _fetch;
 }
 
+void CVICII::drawLineState(const VicLineState *state) {
+    _screenMode = state->screenMode;
+    _scrollX = state->scrollX;
+    _CSEL = state->CSEL;
+    _RSEL = state->RSEL;
+    _DEN = state->DEN;
+    _regBorderColor = state->regBorderColor;
+    memcpy(_regBC, state->regBC, sizeof(_regBC));
+    memcpy(_regM, state->regM, sizeof(_regM));
+    _regMSBX = state->regMSBX;
+    _regSpriteEnabled = state->regSpriteEnabled;
+    _regSpriteYExpansion = state->regSpriteYExpansion;
+    _regSpriteXExpansion = state->regSpriteXExpansion;
+    _regSpriteMultiColor = state->regSpriteMultiColor;
+    memcpy(_regMM, state->regMM, sizeof(_regMM));
+    memcpy(_regMC, state->regMC, sizeof(_regMC));
+    _fetch = state->fetch;
+    _clipStart = state->fromX;
+    _clipEnd = state->toX;
+    drawLine(state->line);
+}
+
+void CVICII::setRenderThread(CRenderThread *renderThread) {
+    _renderThread = renderThread;
+    memset(_lineSignatures, 0, sizeof(_lineSignatures));
+}
+
+/**
+ * @brief check if a sprite is displayed (and then fetched) on a rasterline
+ * @param idx the sprite index 0-7
+ * @param rasterLine the rasterline
+ * @return bool
+ */
+bool CVICII::isSpriteDmaLine(int idx, int rasterLine) {
+    if (!isSpriteEnabled(idx)) {
+        return false;
+    }
+    int h = isSpriteYExpanded(idx) ? 42 : 21;
+    int y = getSpriteYCoordinate(idx);
+    return rasterLine >= y && rasterLine < y + h;
+}
+
+
 void CVICII::read(uint16_t address, uint8_t *bt) {
     // check shadow address
     uint16_t addr = handleShadowAddress(address);
@@ -826,13 +1087,13 @@ void CVICII::read(uint16_t address, uint8_t *bt) {
         break;
 
     case 0xd011:
-        // CR1
-        *bt = _regCR1;
+        // CR1, bit 7 is bit 8 of the raster counter
+        *bt = (_regCR1 & 0x7f) | ((_raster >> 1) & 0x80);
         break;
 
     case 0xd012:
         // RASTER
-        *bt = _regRASTER;
+        *bt = _raster & 0xff;
         break;
 
     case 0xd013:
@@ -991,6 +1252,9 @@ void CVICII::read(uint16_t address, uint8_t *bt) {
 }
 
 void CVICII::write(uint16_t address, uint8_t bt) {
+    // the change applies from the beam position on
+    catchUp();
+
     // check shadow
     uint16_t addr = handleShadowAddress(address);
 
@@ -1037,6 +1301,8 @@ void CVICII::write(uint16_t address, uint8_t bt) {
         // bit 7 also sets bit 8 of the raster irq compare line (bit 8)
         if (IS_BIT_SET(_regCR1, 7)) {
             BIT_SET(_rasterIrqLine, 8);
+        } else {
+            BIT_CLEAR(_rasterIrqLine, 8);
         }
 
         // set screen mode (ECM/B MM bits)
@@ -1044,11 +1310,9 @@ void CVICII::write(uint16_t address, uint8_t bt) {
         break;
 
     case 0xd012:
-        // RASTER
-        _regRASTER = bt;
-
-        // also set the line at which the raster irq happens (bit 0-7)
-        _rasterIrqLine = bt;
+        // set the line at which the raster irq happens (bit 0-7), the
+        // raster counter is not affected
+        _rasterIrqLine = (_rasterIrqLine & 0x100) | bt;
         break;
 
     case 0xd013:
@@ -1227,6 +1491,9 @@ void CVICII::write(uint16_t address, uint8_t bt) {
     // write to memory anyway (attack of the mutant camels)
     // @fixme this is wrong, shouldn't be needed
     _cpu->memory()->writeByte(addr, bt);
+
+    // badline and sprite dma may have changed
+    updateBusMask();
 }
 
 /**
@@ -1403,36 +1670,8 @@ void CVICII::setScreenMode() {
  * 7 of $d011(CR1)
  * @return
  */
-int CVICII::getCurrentRasterLine() {
-    int line = _regRASTER;
-    if (IS_BIT_SET(_regCR1, 7)) {
-        BIT_SET(line, 8);
-    }
-    return line;
-}
+int CVICII::getCurrentRasterLine() { return _raster; }
 
-/**
- * @brief update the current raster line ($d012 and bit7 of $d011)
- * @param line the current line
- */
-void CVICII::setCurrentRasterLine(int line) {
-    if (line > VIC_PAL_SCANLINES) {
-        // reset
-        _regRASTER = 0;
-        BIT_CLEAR(_regCR1, 7);
-        return;
-    }
-
-    // set $d012
-    _regRASTER = line & 0xff;
-
-    // set bit 7 of $d011 accordingly
-    if (line > 0xff) {
-        BIT_SET(_regCR1, 7);
-    } else {
-        BIT_CLEAR(_regCR1, 7);
-    }
-}
 
 /**
  * @brief get the screencode for a position in the 40x25 video matrix
@@ -1478,7 +1717,7 @@ void CVICII::readVICByte(uint16_t address, uint8_t *bt) {
 
     if (readFromCharsetRom) {
         // SDL_Log("vic read from ROM charset");
-        uint8_t *cAddr = ((CMemory *)_cpu->memory())->charset();
+        const uint8_t *cAddr = ((CMemory *)_cpu->memory())->charset();
         if (IS_BIT_SET(addr, 11)) {
             // select the alternate character set in rom
             cAddr += 0x800;
@@ -1568,3 +1807,196 @@ uint8_t CVICII::getMemoryPointers() {
     // bit 0 always set
     return (_regMemoryPointers | 1);
 }
+
+/**
+ * @brief get the cycles per frame of the model
+ * @return
+ */
+int CVICII::cyclesPerFrame() { return _cyclesPerFrame; }
+
+/**
+ * @brief get the cpu clock of the model
+ * @return
+ */
+int CVICII::clockHz() { return _clockHz; }
+
+/**
+ * @brief get the framebuffer rows the model draws
+ * @return
+ */
+int CVICII::screenRows() {
+    int rows = _lastVblankLine - _firstVblankLine + 1;
+    return rows < VIC_SCREEN_H ? rows : VIC_SCREEN_H;
+}
+
+CVICII *CVICII::create(int model, CMOS65xx *cpu, CCIA2 *cia2, CPLA *pla) {
+    switch (model) {
+    case VIC_MODEL_NTSC:
+        return new CVICIIModel<VicTimingNTSC>(cpu, cia2, pla);
+    case VIC_MODEL_NTSC_OLD:
+        return new CVICIIModel<VicTimingNTSCOld>(cpu, cia2, pla);
+    default:
+        return new CVICIIModel<VicTimingPAL>(cpu, cia2, pla);
+    }
+}
+
+template <typename Timing>
+CVICIIModel<Timing>::CVICIIModel(CMOS65xx *cpu, CCIA2 *cia2, CPLA *pla)
+    : CVICII(cpu, cia2, pla) {
+    _cyclesPerFrame = Timing::cyclesPerLine * Timing::scanlines;
+    _clockHz = Timing::clockHz;
+    _firstVblankLine = Timing::firstVblankLine;
+    _lastVblankLine = Timing::lastVblankLine;
+}
+
+template <typename Timing> void CVICIIModel<Timing>::catchUp() {
+    // the beam position at the access, 8 pixels per cycle (the framebuffer
+    // column of sprite X coordinate 0 is firstSpriteX)
+    Rect limits;
+    getScreenLimits(&limits);
+    int cycle = (int)(_cycleCount - _prevCycles) + _accessCycle + 1;
+    int x = limits.firstSpriteX + VIC_DISPLAY_START_X +
+            (cycle - Timing::displayStartCycle) * VIC_PIXELS_PER_CYCLE;
+    if (x < 0) {
+        x = 0;
+    } else if (x > VIC_SCREEN_W || cycle > Timing::cyclesPerLine) {
+        x = VIC_SCREEN_W;
+    }
+    renderLine(getCurrentRasterLine(), x);
+}
+
+/**
+ * @brief compute the cycles of the current line in which the vic takes the
+ * bus. to be called at the start of the line, and when registers change
+ */
+template <typename Timing> void CVICIIModel<Timing>::updateBusMask() {
+    _baMask.reset();
+    if (isBadLine(_raster)) {
+        // c-accesses
+        for (int c = VIC_BADLINE_BA_START; c <= VIC_BADLINE_BA_END; c++) {
+            _baMask.set(c);
+        }
+    }
+    if (_regSpriteEnabled) {
+        int nextLine = (_raster + 1) % Timing::scanlines;
+        for (int idx = 0; idx < 8; idx++) {
+            // relative to the line before the one the sprite is displayed
+            int start = Timing::spriteBaStart + (idx * 2);
+            int end = start + VIC_SPRITE_BA_CYCLES - 1;
+            if (isSpriteDmaLine(idx, nextLine)) {
+                // the dma starts in this line
+                for (int c = start; c <= end && c < Timing::cyclesPerLine;
+                     c++) {
+                    _baMask.set(c);
+                }
+            }
+            if (isSpriteDmaLine(idx, _raster)) {
+                // the dma started in the previous line, and ends in this one
+                for (int c = start - Timing::cyclesPerLine;
+                     c <= end - Timing::cyclesPerLine; c++) {
+                    if (c >= 0) {
+                        _baMask.set(c);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief the beam reached a new line
+ */
+template <typename Timing> void CVICIIModel<Timing>::startLine() {
+    if (IS_BIT_SET(getInterruptEnabled(), 0)) {
+        // handle raster interrupt
+        if (_raster == _rasterIrqLine) {
+            // trigger irq if bits in $d01a is set for the raster
+            // interrupt
+            BIT_SET(_regInterrupt, 0);
+            _cpu->irq();
+        } else {
+            BIT_CLEAR(_regInterrupt, 0);
+        }
+    }
+    updateBusMask();
+}
+
+/**
+ * @brief update the raster counter (read as $d012 and bit7 of $d011)
+ * @param line the current line
+ */
+template <typename Timing>
+void CVICIIModel<Timing>::setCurrentRasterLine(int line) {
+    _raster = (line >= Timing::scanlines) ? 0 : line;
+}
+
+/**
+ * @brief count the cycles of the current line with BA low
+ * @param from the first cycle in the line (clamped to 0)
+ * @param to the cycle after the last one
+ * @return int
+ */
+template <typename Timing>
+int CVICIIModel<Timing>::countBusLow(int from, int to) {
+    int n = 0;
+    for (int c = (from < 0 ? 0 : from); c < to; c++) {
+        n += _baMask.test(c);
+    }
+    return n;
+}
+
+template <typename Timing> int CVICIIModel<Timing>::update(long cycleCount) {
+    _cycleCount = cycleCount;
+
+    // the cycles the last instruction spent with BA low, it couldn't run
+    // in them and must be repeated once the bus is free
+    int lost = 0;
+
+    // lines always take the same cycles
+    while (cycleCount - _prevCycles >= Timing::cyclesPerLine) {
+        // the line is done, render the columns left (all of them, if
+        // nothing changed in the meantime)
+        renderLine(_raster, VIC_SCREEN_W);
+        _renderedX = 0;
+        if (_baMask.any()) {
+            lost += countBusLow((int)(_busCycle - _prevCycles),
+                                Timing::cyclesPerLine);
+        }
+
+        // next line
+        _prevCycles += Timing::cyclesPerLine;
+        setCurrentRasterLine(_raster + 1);
+        if (_raster == 0) {
+            startFrame();
+        }
+        startLine();
+    }
+    if (_baMask.none() && lost == 0) {
+        // fast path, no dma in this line
+        _busCycle = cycleCount;
+        return 0;
+    }
+
+    // the cpu is stopped as long as BA is low, then repeats the cycles it
+    // lost (the cpu writes which may still happen in the first 3 cycles
+    // are not accounted)
+    int c = (int)(cycleCount - _prevCycles);
+    lost += countBusLow((int)(_busCycle - _prevCycles), c);
+    int stolen = 0;
+    while (c < Timing::cyclesPerLine && (lost > 0 || _baMask.test(c))) {
+        if (!_baMask.test(c)) {
+            lost--;
+        }
+        stolen++;
+        c++;
+    }
+
+    // past the end of the line, the bus is free until the next update
+    stolen += lost;
+    _busCycle = cycleCount + stolen;
+    return stolen;
+}
+
+template class CVICIIModel<VicTimingPAL>;
+template class CVICIIModel<VicTimingNTSC>;
+template class CVICIIModel<VicTimingNTSCOld>;
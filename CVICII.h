@@ -4,6 +4,7 @@
 
 #pragma once
 #include <CMOS65xx.h>
+#include <bitset>
 #include "CCIA2.h"
 #include "CPLA.h"
 
@@ -17,14 +18,78 @@
 #define VIC_SCREEN_MODE_BITMAP_MULTICOLOR 3
 #define VIC_SCREEN_MODE_EXTENDED_BACKGROUND_COLOR 4
 
-// sizes comprensive of vblank and hblank
+// framebuffer size, comprensive of vblank and hblank (the PAL one, the NTSC
+// models fit in)
 // http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt
-#define VIC_PAL_SCREEN_W 403
-#define VIC_PAL_SCREEN_H 284
-#define VIC_PAL_SCANLINES 312
-#define VIC_PAL_HZ 985248
-#define VIC_PAL_CYCLES_PER_LINE 63
-#define VIC_PAL_CYCLES_PER_BADLINE 23
+#define VIC_SCREEN_W 403
+#define VIC_SCREEN_H 284
+
+/**
+ * vic models
+ */
+#define VIC_MODEL_PAL 0      // 6569
+#define VIC_MODEL_NTSC 1     // 6567R8
+#define VIC_MODEL_NTSC_OLD 2 // 6567R56A
+
+/**
+ * bus cycles taken by the vic (BA low, the cpu is stopped), as line cycles
+ * starting from 0 (cycle 1 in vic-ii.txt). BA goes low 3 cycles before the
+ * first access.
+ * badlines: c-accesses in cycles 14-53.
+ * sprites: s-accesses in the line before the sprite is displayed, from the
+ * model spriteBaStart + 3 (sprite 0), 2 cycles per sprite, wrapping in the
+ * next line
+ */
+#define VIC_BADLINE_BA_START 11
+#define VIC_BADLINE_BA_END 53
+#define VIC_SPRITE_BA_CYCLES 5
+
+/**
+ * the beam draws 8 pixels per cycle, and reaches X=$18 (the first column of
+ * the 40 columns display window, in sprite coordinates) in the model
+ * displayStartCycle (cycle number as in vic-ii.txt, from 1)
+ */
+#define VIC_PIXELS_PER_CYCLE 8
+#define VIC_DISPLAY_START_X 0x18
+
+/**
+ * @brief timing of the PAL 6569
+ */
+struct VicTimingPAL {
+    static const int cyclesPerLine = 63;
+    static const int displayStartCycle = 17; // the beam at X=$18
+    static const int scanlines = 312;
+    static const int clockHz = 985248;
+    static const int firstVblankLine = 15; // first line drawn at all
+    static const int lastVblankLine = 300; // last line drawn at all
+    static const int spriteBaStart = 54;
+};
+
+/**
+ * @brief timing of the NTSC 6567R8
+ */
+struct VicTimingNTSC {
+    static const int cyclesPerLine = 65;
+    static const int displayStartCycle = 17;
+    static const int scanlines = 263;
+    static const int clockHz = 1022727;
+    static const int firstVblankLine = 27;
+    static const int lastVblankLine = 262;
+    static const int spriteBaStart = 55;
+};
+
+/**
+ * @brief timing of the old NTSC 6567R56A
+ */
+struct VicTimingNTSCOld {
+    static const int cyclesPerLine = 64;
+    static const int displayStartCycle = 17;
+    static const int scanlines = 262;
+    static const int clockHz = 1022727;
+    static const int firstVblankLine = 27;
+    static const int lastVblankLine = 261;
+    static const int spriteBaStart = 54;
+};
 
 /**
  * registers
@@ -55,32 +120,98 @@ typedef struct _rect {
     int firstSpriteX; // this is the first column to start displaying sprites
 } Rect;
 
+/**
+ * @brief the memory a line is drawn from, read by fetchLine()
+ */
+typedef struct _vicFetch {
+    bool window;          // the line is in the display window
+    uint8_t spriteMask;   // sprites drawn on the line
+    uint8_t screen[40];   // video matrix
+    uint8_t color[40];    // color ram
+    uint8_t data[40];     // character/bitmap data
+    uint8_t sprite[8][3]; // sprite rows
+} VicFetch;
+
+/**
+ * @brief everything a line (or part of it) is drawn from, to draw it
+ * elsewhere (the render thread)
+ */
+typedef struct _vicLineState {
+    int16_t line;  // the rasterline
+    int16_t fromX; // first column to draw
+    int16_t toX;   // first column not to draw
+    uint8_t screenMode;
+    uint8_t scrollX;
+    bool CSEL;
+    bool RSEL;
+    bool DEN;
+    uint8_t regBorderColor;
+    uint8_t regBC[4];
+    uint8_t regM[16];
+    uint8_t regMSBX;
+    uint8_t regSpriteEnabled;
+    uint8_t regSpriteYExpansion;
+    uint8_t regSpriteXExpansion;
+    uint8_t regSpriteMultiColor;
+    uint8_t regMM[2];
+    uint8_t regMC[8];
+    VicFetch fetch;
+} VicLineState;
+
+class CRenderThread;
+
 /**
  * @brief callback to set the pixel at the specific position
  */
 typedef void (*BlitCallback)(void *thisPtr, RgbStruct *rgb, int pos);
 
 /**
- * emulates the vic-ii 6569 chip
+ * emulates the vic-ii chip. the timing dependent parts are implemented by
+ * CVICIIModel, for each model
  */
 class CVICII {
     friend class CDisplay;
+    template <typename Timing> friend class CVICIIModel;
 
   public:
     /**
-     * constructor
+     * create the chip
+     * @param model one of the VIC_MODEL values
      * @param cpu the cpu
      * @param cia2 the CIA-2 chip
      * @param pla the PLA chip
+     * @return the chip, to be deleted by the caller
      */
-    CVICII(CMOS65xx *cpu, CCIA2 *cia2, CPLA *pla);
+    static CVICII *create(int model, CMOS65xx *cpu, CCIA2 *cia2, CPLA *pla);
+
+    virtual ~CVICII() {}
 
     /**
-     * update the internal state
+     * update the internal state, running the lines elapsed
      * @param current cycle count
-     * @return additional cycles used
+     * @return cycles the cpu must be stopped for from now, since the vic
+     * takes the bus (badline and sprite dma)
+     */
+    virtual int update(long cycleCount) = 0;
+
+    /**
+     * @brief get the cycles per frame of the model
+     * @return int
      */
-    int update(long cycleCount);
+    int cyclesPerFrame();
+
+    /**
+     * @brief get the cpu clock of the model
+     * @return int (hz)
+     */
+    int clockHz();
+
+    /**
+     * @brief get the framebuffer rows the model draws, the rows below are
+     * never written
+     * @return int
+     */
+    int screenRows();
 
     /**
      * read from chip memory
@@ -108,7 +239,75 @@ class CVICII {
     void setCollisionHandling(bool enableSpriteSprite,
                               bool enableBackgroundSprite);
 
+    /**
+     * @brief enable/disable drawing, raster timing and interrupts are
+     * handled anyway (i.e. when playing SID tunes)
+     * @param enable enable/disable
+     */
+    void setRenderingEnabled(bool enable);
+
+    /**
+     * @brief keep the framebuffer rows of the lines unchanged since the
+     * previous frame (default). to be disabled if the framebuffer content is
+     * lost between frames
+     * @param enable enable/disable
+     */
+    void setKeepUnchangedLines(bool enable);
+
+    /**
+     * @brief skip drawing some frames. raster irqs, badlines and collisions
+     * are handled as usual (lines with sprites are still drawn without
+     * producing pixels, if collisions are enabled)
+     * @param skip frames to skip
+     * @param every out of these
+     */
+    void setFrameSkip(int skip, int every);
+
+    /**
+     * @brief check if the last complete frame was skipped (nothing new to
+     * display)
+     * @return bool
+     */
+    bool wasFrameSkipped();
+
+    /**
+     * @brief draw lines through a render thread, the vic just detects the
+     * collisions
+     * @param renderThread the render thread, or nullptr to draw here
+     */
+    void setRenderThread(CRenderThread *renderThread);
+
+    /**
+     * @brief draw a line from its state, on the render thread
+     * @param state the line state
+     */
+    void drawLineState(const VicLineState *state);
+
+    /**
+     * @brief render the current line up to the beam position, to be called
+     * before anything the display depends on changes (i.e. color ram
+     * writes, register writes do it already). the rest of the line is
+     * rendered when it ends
+     */
+    virtual void catchUp() = 0;
+
+    /**
+     * @brief set the cycle, in the cpu instruction being executed, of the
+     * next register or color ram access (the vic is updated at instruction
+     * boundaries)
+     * @param cycle the cycle, 0-based
+     */
+    void setAccessCycle(int cycle);
+
   protected:
+    /**
+     * constructor
+     * @param cpu the cpu
+     * @param cia2 the CIA-2 chip
+     * @param pla the PLA chip
+     */
+    CVICII(CMOS65xx *cpu, CCIA2 *cia2, CPLA *pla);
+
     /**
      * set blitting callback
      * @param display opaque pointer to the display handler
@@ -119,7 +318,12 @@ class CVICII {
   private:
     CMOS65xx *_cpu = nullptr;
     void *_displayObj = nullptr;
-    int _prevCycles = 0;
+    long _prevCycles = 0; // cycle at which the current line started
+    int _raster = 0;       // raster counter
+    int _cyclesPerFrame = 0;
+    int _clockHz = 0;
+    int _firstVblankLine = 0;
+    int _lastVblankLine = 0;
     uint16_t _rasterIrqLine = 0;
     int _scrollX = 0;
     int _scrollY = 0;
@@ -130,7 +334,6 @@ class CVICII {
                                 // (M0X,M0Y ... M7X,M7Y)
     uint8_t _regMSBX = 0;
     uint8_t _regCR1 = 0;
-    uint16_t _regRASTER = 0;
     uint8_t _regLP[2] = {0};
     uint8_t _regSpriteEnabled = 0;
     uint8_t _regCR2 = 0;
@@ -158,6 +361,22 @@ class CVICII {
     CPLA *_pla = nullptr;
     bool _sprSprHwCollisionEnabled = true;
     bool _sprBckHwCollisionEnabled = true;
+    bool _renderingEnabled = true;
+    bool _keepUnchangedLines = true;
+    long _cycleCount = 0;
+    int _accessCycle = 0;
+    int _renderedX = 0; // first column of the current line not rendered yet
+    int _clipStart = 0; // columns blitted by the current render pass
+    int _clipEnd = VIC_SCREEN_W;
+    uint64_t _lineSignatures[VIC_SCREEN_H] = {0}; // of the previous frame
+    int64_t _frames = 0;
+    int _frameSkip = 0;
+    int _frameSkipEvery = 1;
+    bool _frameSkipped = false;
+    bool _lastFrameSkipped = false;
+    bool _noPixels = false; // drawing to detect collisions only
+    VicFetch _fetch = {};
+    CRenderThread *_renderThread = nullptr;
     uint16_t handleShadowAddress(uint16_t address);
 
     bool isSpriteEnabled(int idx);
@@ -180,6 +399,16 @@ class CVICII {
     uint16_t getSpriteXCoordinate(int idx);
     uint8_t getSpriteYCoordinate(int idx);
 
+    bool isBadLine(int rasterLine);
+    bool isSpriteDmaLine(int idx, int rasterLine);
+    virtual void updateBusMask() = 0;
+    uint64_t lineSignature();
+    bool isCollisionDetectionEnabled();
+    void fetchLine(int line);
+    void drawLine(int line);
+    void saveLineState(VicLineState *state, int line);
+    void startFrame();
+    void renderLine(int rasterLine, int toX);
     void drawBorder(int rasterLine);
     void drawCharacterMode(int rasterLine);
 
@@ -193,7 +422,6 @@ class CVICII {
     uint16_t getSpriteDataAddress(int idx);
     void getScreenLimits(Rect *limits);
     int getCurrentRasterLine();
-    void setCurrentRasterLine(int line);
     void drawBitmapMode(int rasterLine);
     uint8_t getScreenCode(int x, int y);
     uint8_t getScreenColor(int x, int y);
@@ -208,3 +436,34 @@ class CVICII {
     uint8_t getInterruptEnabled();
     uint8_t getMemoryPointers();
 };
+
+/**
+ * @brief the timing dependent parts of the vic (raster, bus stealing, beam
+ * position), with the constants of the model folded at compile time
+ * @tparam Timing one of the VicTiming structs
+ */
+template <typename Timing> class CVICIIModel : public CVICII {
+  public:
+    /**
+     * constructor
+     * @param cpu the cpu
+     * @param cia2 the CIA-2 chip
+     * @param pla the PLA chip
+     */
+    CVICIIModel(CMOS65xx *cpu, CCIA2 *cia2, CPLA *pla);
+
+    int update(long cycleCount) override;
+    void catchUp() override;
+
+  private:
+    // bit n set = BA low at cycle n of the line
+    std::bitset<Timing::cyclesPerLine> _baMask;
+
+    // the bus is accounted up to this cycle (the cpu ran, or was stalled)
+    long _busCycle = 0;
+
+    void updateBusMask() override;
+    int countBusLow(int from, int to);
+    void startLine();
+    void setCurrentRasterLine(int line);
+};
@@ -0,0 +1,112 @@
+#include "CWatchpoints.h"
+#include <SDL.h>
+#include <CBuffer.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+CWatchpoints::CWatchpoints() {
+    _trace = (TraceEntry *)calloc(WATCH_TRACE_SIZE, sizeof(TraceEntry));
+}
+
+CWatchpoints::~CWatchpoints() { SAFE_FREE(_trace) }
+
+int CWatchpoints::add(const char *spec) {
+    // parse the whole spec first, nothing is applied if it's invalid
+    std::string tmp = spec;
+    std::vector<WatchRange> ranges;
+    char *ctx = nullptr;
+    for (char *s = strtok_r(&tmp[0], ",", &ctx); s;
+         s = strtok_r(nullptr, ",", &ctx)) {
+        WatchRange r = {0, 0, 0};
+        char *p = s;
+        for (; *p && *p != ':'; p++) {
+            if (*p == 'r') {
+                r.flags |= WATCH_READ;
+            } else if (*p == 'w') {
+                r.flags |= WATCH_WRITE;
+            } else if (*p == 'x') {
+                r.flags |= WATCH_EXECUTE;
+            } else {
+                return EINVAL;
+            }
+        }
+        if (*p != ':' || r.flags == 0) {
+            return EINVAL;
+        }
+        char *end;
+        unsigned long start = strtoul(p + 1, &end, 16);
+        unsigned long last = start;
+        if (*end == '-') {
+            last = strtoul(end + 1, &end, 16);
+        }
+        if (end == p + 1 || *end != '\0' || start > 0xffff || last > 0xffff ||
+            last < start) {
+            return EINVAL;
+        }
+        r.start = (uint16_t)start;
+        r.end = (uint16_t)last;
+        ranges.push_back(r);
+    }
+
+    for (size_t i = 0; i < ranges.size(); i++) {
+        WatchRange &r = ranges[i];
+        _ranges.push_back(r);
+        for (int page = r.start >> 8; page <= r.end >> 8; page++) {
+            _pages[page] |= r.flags;
+        }
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "watchpoint: $%04x-$%04x, %s%s%s", r.start, r.end,
+                    (r.flags & WATCH_READ) ? "r" : "",
+                    (r.flags & WATCH_WRITE) ? "w" : "",
+                    (r.flags & WATCH_EXECUTE) ? "x" : "");
+    }
+    return 0;
+}
+
+void CWatchpoints::access(uint16_t address, uint8_t value, uint8_t type,
+                          int64_t cycle, uint16_t pc) {
+    if (!(_pages[address >> 8] & type)) {
+        return;
+    }
+    for (size_t i = 0; i < _ranges.size(); i++) {
+        WatchRange &r = _ranges[i];
+        if (address >= r.start && address <= r.end && (r.flags & type)) {
+            TraceEntry *e = &_trace[_hits & (WATCH_TRACE_SIZE - 1)];
+            e->cycle = (uint64_t)cycle;
+            e->pc = pc;
+            e->address = address;
+            e->value = value;
+            e->type = type;
+            _hits++;
+            return;
+        }
+    }
+}
+
+int CWatchpoints::dump(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        int res = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s: %s", strerror(res),
+                     path);
+        return res;
+    }
+
+    // oldest first, in host byte order
+    uint32_t count =
+        _hits < WATCH_TRACE_SIZE ? (uint32_t)_hits : WATCH_TRACE_SIZE;
+    fwrite(WATCH_TRACE_MAGIC, strlen(WATCH_TRACE_MAGIC), 1, f);
+    fwrite(&count, sizeof(count), 1, f);
+    uint64_t first = _hits - count;
+    for (uint64_t i = first; i < _hits; i++) {
+        fwrite(&_trace[i & (WATCH_TRACE_SIZE - 1)], sizeof(TraceEntry), 1, f);
+    }
+    fclose(f);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "trace dumped to %s, %u entries (%llu hits)", path, count,
+                (unsigned long long)_hits);
+    return 0;
+}
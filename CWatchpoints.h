@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @brief watchpoint types (flags)
+ */
+#define WATCH_READ 1
+#define WATCH_WRITE 2
+#define WATCH_EXECUTE 4
+
+/**
+ * @brief trace ring size, in entries (power of 2)
+ */
+#define WATCH_TRACE_SIZE 0x10000
+
+/**
+ * @brief trace file magic, followed by the number of entries (32 bit) and the
+ * entries, oldest first. all in host byte order
+ */
+#define WATCH_TRACE_MAGIC "VC64TRC1"
+
+/**
+ * @brief a watchpoint hit
+ */
+#pragma pack(push, 1)
+typedef struct _traceEntry {
+    uint64_t cycle;   // total cpu cycles
+    uint16_t pc;      // address of the instruction accessing
+    uint16_t address; // address accessed
+    uint8_t value;    // value read/written (opcode, for execute)
+    uint8_t type;     // WATCH_READ, WATCH_WRITE or WATCH_EXECUTE
+    uint8_t pad[2];
+} TraceEntry;
+#pragma pack(pop)
+
+/**
+ * @brief a watched range
+ */
+typedef struct _watchRange {
+    uint16_t start;
+    uint16_t end; // inclusive
+    uint8_t flags;
+} WatchRange;
+
+/**
+ * @brief memory watchpoints on address ranges. watched pages are flagged in a
+ * 256 entries table, so accesses to the other pages only cost a lookup. hits
+ * go to a ring buffer, which can be dumped to file
+ */
+class CWatchpoints {
+  public:
+    CWatchpoints();
+    ~CWatchpoints();
+
+    /**
+     * @brief add a watchpoint
+     * @param spec r|w|x (any combination) ':' start['-'end], hex addresses,
+     * i.e. "w:c000-c0ff" or "rx:e544". more specs can be separated by ','
+     * @return 0 on success, or EINVAL
+     */
+    int add(const char *spec);
+
+    /**
+     * @brief check if the page of the address is watched at all
+     * @param address the address
+     * @return bool
+     */
+    inline bool isWatched(uint16_t address) {
+        return _pages[address >> 8] != 0;
+    }
+
+    /**
+     * @brief check an access to a watched page, and trace it if it hits
+     * @param address the address
+     * @param value value read/written
+     * @param type WATCH_READ, WATCH_WRITE or WATCH_EXECUTE
+     * @param cycle total cpu cycles
+     * @param pc address of the current instruction
+     */
+    void access(uint16_t address, uint8_t value, uint8_t type, int64_t cycle,
+                uint16_t pc);
+
+    /**
+     * @brief write the trace to file, oldest entry first
+     * @param path path to the file
+     * @return 0 on success, or errno
+     */
+    int dump(const char *path);
+
+  private:
+    uint8_t _pages[256] = {0};
+    std::vector<WatchRange> _ranges = {};
+    TraceEntry *_trace = nullptr;
+    uint64_t _hits = 0;
+};
@@ -7,6 +7,7 @@
 #include <CBuffer.h>
 #include <CMOS65xx.h>
 #include <getopt.h>
+#include <atomic>
 #include "CDisplay.h"
 #include "CInput.h"
 #include "CAudio.h"
@@ -16,6 +17,16 @@
 #include "CVICII.h"
 #include "CSID.h"
 #include "CPLA.h"
+#include "CSIDPlayer.h"
+#include "CMovie.h"
+#include "CKernalTrap.h"
+#include "CBootSnapshot.h"
+#include "CWatchpoints.h"
+#include "CHeatmap.h"
+#include "CProfiler.h"
+#include "CRenderThread.h"
+#include "CScaler.h"
+#include "CCapture.h"
 
 /**
  * globals
@@ -30,7 +41,17 @@ CCIA1 *cia1 = nullptr;
 CCIA2 *cia2 = nullptr;
 CSID *sid = nullptr;
 CPLA *pla = nullptr;
-bool running = true;
+CSIDPlayer *sidPlayer = nullptr;
+CMovie *movie = nullptr;
+CKernalTrap *kernalTrap = nullptr;
+CBootSnapshot *bootSnapshot = nullptr;
+CWatchpoints *watchpoints = nullptr;
+CHeatmap *heatmap = nullptr;
+CProfiler *profiler = nullptr;
+CRenderThread *renderThread = nullptr;
+int profilerTopN = 0;
+char *labelsPath = nullptr;
+std::atomic<bool> running(true);
 bool debugger = false;
 bool hotkeyDbgBreak = false;
 int64_t totalCycles = 0;
@@ -38,6 +59,67 @@ char *path = nullptr;
 bool joy2HackEnabled = false;
 int joyNum = 0;
 int64_t frames = 0;
+int audioQuality = AUDIO_QUALITY_MEDIUM;
+bool headless = false;
+char *audioPath = nullptr;
+int sidSong = 0;
+int64_t maxCycles = 0;
+char *scriptPath = nullptr;
+char *moviePath = nullptr;
+bool moviePlayback = false;
+char *device8Path = nullptr;
+bool useBootSnapshot = false;
+int vicModel = VIC_MODEL_PAL;
+int frameSkip = 0;
+int frameSkipEvery = 1;
+bool useRenderThread = false;
+bool asyncPresent = false;
+// the main thread pumps the events, the emulation thread just dequeues them
+bool pumpOnMainThread = false;
+// the emulation thread asks the main thread to read the clipboard, and gets
+// the text back
+std::atomic<bool> pasteRequested(false);
+std::atomic<char *> pastedText(nullptr);
+bool zeroCopy = false;
+CScaler *scaler = nullptr;
+char *capturePath = nullptr;
+CCapture *capture = nullptr;
+bool bootSnapshotPending = false;
+
+// the first read of each cpu step is the opcode fetch
+bool opcodeFetch = false;
+uint16_t currentPc = 0;
+uint8_t currentOpcode = 0;
+
+/**
+ * @brief 6502 cycles per opcode (without page crossing/branch penalties).
+ * stores and read-modify-write instructions write in their last cycle
+ */
+static const uint8_t opcodeCycles[256] = {
+    7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6, // $00
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // $10
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6, // $20
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // $30
+    6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6, // $40
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // $50
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6, // $60
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // $70
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, // $80
+    2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5, // $90
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, // $a0
+    2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4, // $b0
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, // $c0
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // $d0
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, // $e0
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // $f0
+};
+#define TRACE_PATH "./vc64-trace.bin"
+
+// cycles needed for the kernal to boot BASIC
+int64_t basicReadyCycles = 2570000;
+
+// the BASIC main loop, reached once the cold start printed READY.
+#define BASIC_MAIN_LOOP 0xa480
 
 /**
  * shows banner
@@ -47,69 +129,166 @@ void banner() {
            "\t(c)opyleft, valerino, y2k19\n");
 }
 
+/**
+ * @brief an I/O page handler. the chips mirror their registers over their
+ * pages (vic every 64 bytes, sid every 32, cia1/cia2 every 16)
+ */
+typedef struct _ioPage {
+    void (*read)(uint16_t address, uint8_t *val);
+    void (*write)(uint16_t address, uint8_t val);
+} IoPage;
+
+static void ioRamRead(uint16_t address, uint8_t *val) {
+    mem->readByte(address, val);
+}
+static void ioRamWrite(uint16_t address, uint8_t val) {
+    mem->writeByte(address, val);
+}
+static void ioColorRamWrite(uint16_t address, uint8_t val) {
+    // the change applies from the beam position on (the write cycle is the
+    // last of the instruction)
+    vic->setAccessCycle(opcodeCycles[currentOpcode] - 1);
+    vic->catchUp();
+    mem->writeByte(address, val);
+}
+static void ioVicRead(uint16_t address, uint8_t *val) {
+    vic->read(address, val);
+}
+static void ioVicWrite(uint16_t address, uint8_t val) {
+    // the write cycle is the last of the instruction
+    vic->setAccessCycle(opcodeCycles[currentOpcode] - 1);
+    vic->write(address, val);
+}
+static void ioSidRead(uint16_t address, uint8_t *val) {
+    sid->read(address, val);
+}
+static void ioSidWrite(uint16_t address, uint8_t val) {
+    sid->write(address, val);
+}
+static void ioCia1Read(uint16_t address, uint8_t *val) {
+    cia1->read(address, val);
+}
+static void ioCia1Write(uint16_t address, uint8_t val) {
+    cia1->write(address, val);
+}
+static void ioCia2Read(uint16_t address, uint8_t *val) {
+    cia2->read(address, val);
+}
+static void ioCia2Write(uint16_t address, uint8_t val) {
+    cia2->write(address, val);
+}
+
+/**
+ * I/O2, kernal traps in the lower half and boot snapshot in the upper half
+ */
+static void ioIo2Read(uint16_t address, uint8_t *val) {
+    if (address <= KERNAL_TRAP_END && kernalTrap) {
+        kernalTrap->read(address, val);
+    } else if (address >= BOOT_SNAPSHOT_TRAP_START && bootSnapshot) {
+        bootSnapshot->read(address, val);
+    } else {
+        mem->readByte(address, val);
+    }
+}
+static void ioIo2Write(uint16_t address, uint8_t val) {
+    if (address <= KERNAL_TRAP_END && kernalTrap) {
+        kernalTrap->write(address, val);
+    } else if (address >= BOOT_SNAPSHOT_TRAP_START && bootSnapshot) {
+        bootSnapshot->write(address, val);
+    } else {
+        mem->writeByte(address, val);
+    }
+}
+
+/**
+ * the $d000-$dfff I/O area, one entry per page (address bits 8-11). color
+ * ram and I/O1 are plain ram (color ram writes catch up the vic first)
+ */
+IoPage ioPages[16] = {
+    {ioVicRead, ioVicWrite},      // $d000
+    {ioVicRead, ioVicWrite},      // $d100
+    {ioVicRead, ioVicWrite},      // $d200
+    {ioVicRead, ioVicWrite},      // $d300
+    {ioSidRead, ioSidWrite},      // $d400
+    {ioSidRead, ioSidWrite},      // $d500
+    {ioSidRead, ioSidWrite},      // $d600
+    {ioSidRead, ioSidWrite},      // $d700
+    {ioRamRead, ioColorRamWrite}, // $d800
+    {ioRamRead, ioColorRamWrite}, // $d900
+    {ioRamRead, ioColorRamWrite}, // $da00
+    {ioRamRead, ioColorRamWrite}, // $db00
+    {ioCia1Read, ioCia1Write},    // $dc00
+    {ioCia2Read, ioCia2Write},    // $dd00
+    {ioRamRead, ioRamWrite},      // $de00
+    {ioIo2Read, ioIo2Write},      // $df00
+};
+
 /**
  * a callback for memory writes
  */
 void cpuCallbackWrite(uint16_t address, uint8_t val) {
-    int mapType = pla->mapAddressToType(address);
-
-    // write to ram or chips
-    if (address >= VIC_REGISTERS_START && address <= VIC_REGISTERS_END) {
-        if (mapType == PLA_MAP_IO_DEVICES) {
-            // access VIC registers
-            vic->write(address, val);
-            return;
-        }
-    } else if (address >= CIA2_REGISTERS_START &&
-               address <= CIA2_REGISTERS_END) {
-        if (mapType == PLA_MAP_IO_DEVICES) {
-            // access CIA2 registers
-            cia2->write(address, val);
-            return;
-        }
-    } else if (address >= CIA1_REGISTERS_START &&
-               address <= CIA1_REGISTERS_END) {
-        if (mapType == PLA_MAP_IO_DEVICES) {
-            // access CIA1 registers
-            cia1->write(address, val);
-            return;
-        }
+    if (heatmap) {
+        heatmap->count(address, HEATMAP_WRITE);
+    }
+    if (watchpoints && watchpoints->isWatched(address)) {
+        watchpoints->access(address, val, WATCH_WRITE, totalCycles, currentPc);
+    }
+    if ((address & 0xf000) == 0xd000 &&
+        pla->mapAddressToType(address) == PLA_MAP_IO_DEVICES) {
+        // write to chips
+        ioPages[(address >> 8) & 0xf].write(address, val);
+        return;
     }
 
     // default, write to ram
     mem->writeByte(address, val);
+    if (kernalTrap && (address & 0xfffc) == KERNAL_RAM_VECTOR_ILOAD) {
+        // RESTOR setting the LOAD/SAVE vectors
+        kernalTrap->checkVectors();
+    }
 }
 
 /**
  * a callback for memory reads
  */
 void cpuCallbackRead(uint16_t address, uint8_t *val) {
-    int mapType = pla->mapAddressToType(address);
-
-    // read from ram or chips
-    if (address >= VIC_REGISTERS_START && address <= VIC_REGISTERS_END) {
-        if (mapType == PLA_MAP_IO_DEVICES) {
-            // access VIC registers
-            vic->read(address, val);
-            return;
-        }
-    } else if (address >= CIA2_REGISTERS_START &&
-               address <= CIA2_REGISTERS_END) {
-        if (mapType == PLA_MAP_IO_DEVICES) {
-            // access CIA2 registers
-            cia2->read(address, val);
-            return;
-        }
-    } else if (address >= CIA1_REGISTERS_START &&
-               address <= CIA1_REGISTERS_END) {
-        if (mapType == PLA_MAP_IO_DEVICES) {
-            // access CIA1 registers
-            cia1->read(address, val);
-            return;
-        }
+    if ((address & 0xf000) == 0xd000 &&
+        pla->mapAddressToType(address) == PLA_MAP_IO_DEVICES) {
+        // read from chips
+        ioPages[(address >> 8) & 0xf].read(address, val);
+    } else {
+        // default, read from ram
+        mem->readByte(address, val);
     }
-    // default, read from ram
-    mem->readByte(address, val);
+
+    bool fetch = opcodeFetch;
+    if (fetch) {
+        // track the instruction address
+        opcodeFetch = false;
+        currentPc = address;
+        currentOpcode = *val;
+    }
+    if (heatmap) {
+        heatmap->count(address, fetch ? HEATMAP_EXECUTE : HEATMAP_READ);
+    }
+    if (watchpoints && watchpoints->isWatched(address)) {
+        watchpoints->access(address, *val, fetch ? WATCH_EXECUTE : WATCH_READ,
+                            totalCycles, currentPc);
+    }
+}
+
+/**
+ * @brief get the next SDL event, if any
+ * @param ev on successful return, the event
+ * @return bool
+ */
+bool nextSdlEvent(SDL_Event *ev) {
+    if (pumpOnMainThread) {
+        // SDL_PollEvent() pumps, which must be done by the main thread
+        return SDL_PeepEvents(ev, 1, SDL_GETEVENT, SDL_FIRSTEVENT,
+                              SDL_LASTEVENT) > 0;
+    }
+    return SDL_PollEvent(ev) != 0;
 }
 
 /**
@@ -118,7 +297,7 @@ void cpuCallbackRead(uint16_t address, uint8_t *val) {
  */
 void pollSdlEvents() {
     SDL_Event ev;
-    while (SDL_PollEvent(&ev)) {
+    while (nextSdlEvent(&ev)) {
         if (ev.type == SDL_QUIT) {
             // SDL window closed, application must quit asap
             SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "QUIT requested!");
@@ -139,16 +318,26 @@ void pollSdlEvents() {
                 hotkeyDbgBreak = true;
             } else if (hotkeys == HOTKEY_PASTE_TEXT) {
                 // fill the clipboard queue to be processed in the main loop
-                input->fillClipboardQueue();
+                if (pumpOnMainThread) {
+                    // the clipboard must be read by the main thread
+                    pasteRequested = true;
+                } else {
+                    input->fillClipboardQueue();
+                }
             } else if (hotkeys == HOTKEY_JOY2_HACK_SWITCH) {
-                if (joyNum == 2) {
+                if (joyNum == 2 && !(movie && movie->isPlaying())) {
                     // enable/disable joy2 hack
                     joy2HackEnabled = !joy2HackEnabled;
+                    if (movie) {
+                        movie->joy2Hack(joy2HackEnabled);
+                    }
                     cia1->enableJoy2Hack(joy2HackEnabled);
                     SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                                 "HOTKEY JOY2HACK, setting status=%s",
                                 joy2HackEnabled ? "enabled" : "disabled");
                 }
+            } else if (hotkeys == HOTKEY_DUMP_TRACE && watchpoints) {
+                watchpoints->dump(TRACE_PATH);
             } else if (hotkeys == HOTKEY_FORCE_EXIT) {
                 // force exit
                 SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "HOTKEY FORCE exit!");
@@ -168,7 +357,7 @@ void pollSdlEvents() {
  */
 void usage(char **argv) {
     printf("usage: %s -f <file> [-dsh]\n"
-           "\t-f: file to be loaded (PRG only is supported as now)\n"
+           "\t-f: file to be loaded (PRG, or PSID/RSID .sid tune)\n"
            "\t-t: run cpu test in test/6502_functional_test.bin\n"
            "\t-j: 1|2, joystick in port 1 or 2 (default is 0, no joystick. "
            "either, arrows=directions, leftshift=fire).\n\t\t"
@@ -180,6 +369,47 @@ void usage(char **argv) {
            "\t-s: fullscreen\n"
            "\t-c: off|nospr|nobck (to disable hw collisions sprite/sprite, "
            "sprite/background, all. default is all collisions enabled)\n"
+           "\t-q: fast|medium|high, audio resampler quality (default is "
+           "medium)\n"
+           "\t-n: headless, no display/audio device and no throttling (runs "
+           "as fast as possible)\n"
+           "\t-o: write audio to file (raw 16 bit mono PCM if it ends with "
+           ".raw, either WAV)\n"
+           "\t-l: stop after the given number of cpu cycles\n"
+           "\t-u: subtune to play, when loading a .sid tune (default is the "
+           "tune's start song)\n"
+           "\t-i: input script to replay (type/key/joy/restore/quit events, "
+           "stamped by frame or cycle)\n"
+           "\t-r: record input to a movie file\n"
+           "\t-p: play back input from a movie file (recorded with the same "
+           "options), live input is ignored\n"
+           "\t-8: folder (.PRG files) or .d64 image to be used as device 8, "
+           "LOAD/SAVE are trapped and done instantly\n"
+           "\t-b: skip the kernal boot using a snapshot of the booted machine "
+           "(saved in the bios folder at the first run, ignored with -r/-p)\n"
+           "\t-w: watchpoints, [r][w][x]:start[-end] (hex, more separated "
+           "by ','). hits are traced to " TRACE_PATH ", on ctrl-t and "
+           "at exit\n"
+           "\t-m: memory heatmap, start:end:prefix. counts reads/writes/"
+           "executes per address in frames [start,end), saved to prefix.csv "
+           "and prefix.pgm\n"
+           "\t-e: profile the cpu, prints the top N routines/instructions by "
+           "cycles at exit\n"
+           "\t-L: VICE label file to resolve symbols in the profiler report\n"
+           "\t-v: video standard, pal (default), ntsc or ntscold (6567R56A)\n"
+           "\t-k: frameskip, n:m skips drawing n frames out of m (emulation "
+           "is unaffected)\n"
+           "\t-T: draw the screen on a separate thread\n"
+           "\t-A: run the emulation on a separate thread, the main thread "
+           "presents the frames (triple buffered, emulation never waits for "
+           "the display)\n"
+           "\t-Z: draw straight into the locked texture, no framebuffer "
+           "copy (ignored with -A)\n"
+           "\t-x: 2|3|4[s][a], scale on the cpu by 2, 3 or 4 (s=scanlines, "
+           "a=PAL pixel aspect), i.e. 3s\n"
+           "\t-V: capture video to file or pipe, YUV4MPEG2 (raw RGB24 and a "
+           ".txt header if it ends with .rgb), scaled with -x. works with "
+           "-n, not with .sid tunes\n"
            "\t-h: this help\n",
            argv[0]);
 }
@@ -204,12 +434,35 @@ void testCpuMain(bool debugger) {
 }
 
 /**
- * @brief load .PRG in memory and inject RUN in the keyboard buffer
+ * @brief LOAD the .PRG through the kernal and RUN it (or install the .sid tune
+ * and start its driver)
  */
 void handlePrgLoading() {
     // enough cycles passed....
+    if (sidPlayer) {
+        SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION,
+                     "cycle=%lld, installing sid at %s", totalCycles, path);
+        char cmd[11];
+        if (sidPlayer->install(mem, cmd, sizeof(cmd)) == 0) {
+            input->injectKeyboardBuffer(cmd);
+        }
+        path = nullptr;
+        return;
+    }
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "cycle=%lld, loading prg at %s",
                  totalCycles, path);
+    if (kernalTrap) {
+        // the file is attached to device 8 (or 1, if 8 is taken), just type
+        // LOAD and RUN
+        if (device8Path) {
+            input->pasteText("LOAD\"\",1,1\rRUN\r");
+        } else {
+            input->pasteText("LOAD\"*\",8,1\rRUN\r");
+        }
+        path = nullptr;
+        return;
+    }
+
     // TODO: determine if it's a prg, either fail....
     int res = mem->loadPrg(path);
     if (res == 0) {
@@ -221,6 +474,150 @@ void handlePrgLoading() {
     path = nullptr;
 }
 
+/**
+ * @brief the emulation loop, runs until the emulator quits
+ */
+void emulationLoop() {
+    // i.e. PAL, 312 lines * 63 cycles = 19656 (50hz = 20ms)
+    int cyclesPerFrame = vic->cyclesPerFrame();
+    int msecPerFrame =
+        (cyclesPerFrame * 1000 + vic->clockHz() / 2) / vic->clockHz();
+    int cycleCounter = cyclesPerFrame;
+    if (heatmap) {
+        heatmap->update(frames);
+    }
+    int vicStall = 0;
+    int timeNow = SDL_GetTicks();
+    while (running) {
+        int cycles;
+        if (vicStall) {
+            // the vic has the bus (badline/sprite dma), the cpu waits
+            cycles = vicStall;
+        } else {
+            // step the cpu
+            opcodeFetch = true;
+            cycles = cpu->step(debugger, debugger ? hotkeyDbgBreak : false);
+            if (cycles == -1) {
+                // exit loop
+                running = false;
+                continue;
+            }
+            if (profiler) {
+                profiler->add(currentPc, cycles);
+            }
+        }
+        totalCycles += cycles;
+        if (movie) {
+            // stamp recorded input, or replay it
+            movie->update(totalCycles);
+        }
+
+        // reset hotkey-dbgbreak status if any (for the debugger)
+        hotkeyDbgBreak = false;
+
+        // update i/o chips
+        cia1->update(totalCycles);
+        cia2->update(totalCycles);
+
+        // the vic tells how long the cpu must wait before the next
+        // instruction
+        vicStall = vic->update(totalCycles);
+
+        // update audio chip
+        sid->update(totalCycles);
+
+        // update cyclecounter
+        cycleCounter -= cycles;
+        if (cycleCounter <= 0) {
+            // draw a frame
+            frames++;
+            if (heatmap) {
+                heatmap->update(frames);
+            }
+            if (display && !vic->wasFrameSkipped()) {
+                if (renderThread) {
+                    // the frame must be complete
+                    renderThread->flush();
+                }
+                display->update();
+            } else if (capture) {
+                // keep the captured video in time
+                capture->repeat();
+            }
+            audio->update();
+            // SDL_Log("totalCycles=%lld, frames=%lld", totalCycles,
+            // frames);
+            cycleCounter += cyclesPerFrame;
+
+            if (!headless) {
+                // poll events
+                pollSdlEvents();
+
+                // sleep for the remaining time, if any
+                int timeThen = SDL_GetTicks();
+                int diff = timeThen - timeNow;
+                if (diff < msecPerFrame) {
+                    SDL_Delay(msecPerFrame - diff);
+                }
+                timeNow = timeThen;
+            }
+
+            // handle clipboard, if any
+            char *txt = pastedText.exchange(nullptr);
+            if (txt) {
+                input->pasteText(txt);
+                SDL_free(txt);
+            }
+            input->checkClipboard();
+        }
+
+        // replay the input script, if any
+        uint32_t scriptHotkeys = 0;
+        input->checkScript(totalCycles, frames, &scriptHotkeys);
+        if (scriptHotkeys == HOTKEY_FORCE_EXIT) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "script exit!");
+            running = false;
+        }
+
+        if (bootSnapshotPending && currentPc == BASIC_MAIN_LOOP) {
+            // BASIC is up, cache the machine for the next runs (unless
+            // input already reached it)
+            uint8_t pending;
+            mem->readByte(198, &pending, true);
+            if (pending == 0) {
+                bootSnapshot->save();
+            } else {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                            "keyboard buffer not empty at READY, boot "
+                            "snapshot not saved");
+            }
+            bootSnapshotPending = false;
+        }
+
+        // once the cpu has reached enough cycles to have loaded the
+        // BASIC interpreter, issue a load of our prg. this trigger only
+        // once!
+        if (totalCycles > basicReadyCycles && path) {
+            // if (frames > 1150 && path) {
+            handlePrgLoading();
+            path = nullptr;
+        }
+
+        if (maxCycles && totalCycles >= maxCycles) {
+            // done
+            running = false;
+        }
+    }
+}
+
+/**
+ * @brief the emulation thread, with the frames presented on the main thread
+ */
+int emulationProc(void *unused) {
+    emulationLoop();
+    return 0;
+}
+
 int main(int argc, char **argv) {
     // prints title
     banner();
@@ -230,7 +627,9 @@ int main(int argc, char **argv) {
 
     // parse commandline
     while (1) {
-        int option = getopt(argc, argv, "dshtc:f:j:");
+        int option = getopt(argc, argv,
+                            "dshtbnTAZc:f:j:q:o:l:u:i:r:p:8:w:m:e:L:v:k:"
+                            "x:V:");
         if (option == -1) {
             break;
         }
@@ -262,6 +661,118 @@ int main(int argc, char **argv) {
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "hw collision disable=%s",
                         collisionDisableType);
             break;
+        case 'q':
+            if (strcmp(optarg, "fast") == 0) {
+                audioQuality = AUDIO_QUALITY_FAST;
+            } else if (strcmp(optarg, "high") == 0) {
+                audioQuality = AUDIO_QUALITY_HIGH;
+            } else {
+                audioQuality = AUDIO_QUALITY_MEDIUM;
+            }
+            break;
+        case 'n':
+            headless = true;
+            break;
+        case 'o':
+            audioPath = optarg;
+            break;
+        case 'l': {
+            char *end;
+            maxCycles = strtoll(optarg, &end, 0);
+            if (end == optarg || *end != '\0' || maxCycles <= 0) {
+                printf("invalid cycle count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case 'u':
+            sidSong = atoi(optarg);
+            break;
+        case 'i':
+            scriptPath = optarg;
+            break;
+        case '8':
+            device8Path = optarg;
+            break;
+        case 'b':
+            useBootSnapshot = true;
+            break;
+        case 'w':
+            if (!watchpoints) {
+                watchpoints = new CWatchpoints();
+            }
+            if (watchpoints->add(optarg) != 0) {
+                printf("invalid watchpoint: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'm':
+            heatmap = new CHeatmap(optarg);
+            if (!heatmap->isValid()) {
+                printf("invalid heatmap range: %s\n", optarg);
+                SAFE_DELETE(heatmap)
+                return 1;
+            }
+            break;
+        case 'e':
+            profilerTopN = atoi(optarg);
+            if (profilerTopN <= 0) {
+                printf("invalid profiler entries: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'L':
+            labelsPath = optarg;
+            break;
+        case 'v':
+            if (strcmp(optarg, "ntsc") == 0) {
+                vicModel = VIC_MODEL_NTSC;
+            } else if (strcmp(optarg, "ntscold") == 0) {
+                vicModel = VIC_MODEL_NTSC_OLD;
+            } else if (strcmp(optarg, "pal") == 0) {
+                vicModel = VIC_MODEL_PAL;
+            } else {
+                printf("invalid video standard: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'k':
+            if (sscanf(optarg, "%d:%d", &frameSkip, &frameSkipEvery) != 2 ||
+                frameSkip < 0 || frameSkip >= frameSkipEvery) {
+                printf("invalid frameskip: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'T':
+            useRenderThread = true;
+            break;
+        case 'A':
+            asyncPresent = true;
+            break;
+        case 'Z':
+            zeroCopy = true;
+            break;
+        case 'V':
+            capturePath = optarg;
+            break;
+        case 'x': {
+            int factor;
+            bool scanlines;
+            bool aspect;
+            if (CScaler::parse(optarg, &factor, &scanlines, &aspect) != 0) {
+                printf("invalid scaler: %s\n", optarg);
+                return 1;
+            }
+            SAFE_DELETE(scaler)
+            scaler = new CScaler(factor, scanlines, aspect, VIC_SCREEN_W,
+                                 VIC_SCREEN_H);
+            break;
+        }
+        case 'r':
+        case 'p':
+            moviePath = optarg;
+            moviePlayback = (option == 'p');
+            break;
         case 'd':
             debugger = true;
             break;
@@ -273,13 +784,19 @@ int main(int argc, char **argv) {
             break;
         }
     }
+    if (capturePath && path && CSIDPlayer::isSIDFile(path)) {
+        // tunes are played with the vic rendering disabled
+        printf("video capture is not supported with .sid tunes\n");
+        SAFE_DELETE(scaler)
+        return 1;
+    }
 
     bool sdlInitialized = false;
     uint32_t startTime = SDL_GetTicks();
     int res = 0;
     do {
         // initialize sdl
-        res = SDL_Init(SDL_INIT_EVERYTHING);
+        res = SDL_Init(headless ? SDL_INIT_TIMER : SDL_INIT_EVERYTHING);
         if (res != 0) {
             SDL_LogError(SDL_LOG_CATEGORY_ERROR, "SDL_Init(): %s",
                          SDL_GetError());
@@ -306,26 +823,123 @@ int main(int argc, char **argv) {
             SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION,
                          "debugging mode ACTIVE!");
         }
+        if (profilerTopN) {
+            profiler = new CProfiler();
+            if (labelsPath && profiler->loadLabels(labelsPath) != 0) {
+                break;
+            }
+        }
+
+        if (!isTestCpu) {
+            // trap kernal LOAD/SAVE for devices 8 and 1
+            kernalTrap = new CKernalTrap(mem);
+            if (device8Path && kernalTrap->attach(8, device8Path) != 0) {
+                break;
+            }
+            if (path && !CSIDPlayer::isSIDFile(path) &&
+                kernalTrap->attach(device8Path ? 1 : 8, path) != 0) {
+                break;
+            }
+            kernalTrap->install();
+
+            if (useBootSnapshot && moviePath) {
+                // the boot timing differs if the snapshot exists or not,
+                // movies always start from a cold boot
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                            "boot snapshot ignored with movies");
+                useBootSnapshot = false;
+            }
+            if (useBootSnapshot) {
+                // resume from the snapshot, or save it once booted
+                bootSnapshot = new CBootSnapshot(mem);
+                if (bootSnapshot->load("./bios", vicModel)) {
+                    // just IOINIT and the VIC setup to be done
+                    basicReadyCycles = 100000;
+                } else {
+                    bootSnapshotPending = true;
+                }
+            }
+        }
 
         // create additional chips
         cia1 = new CCIA1(cpu, pla);
         cia2 = new CCIA2(cpu, pla);
-        vic = new CVICII(cpu, cia2, pla);
+        vic = CVICII::create(vicModel, cpu, cia2, pla);
         sid = new CSID(cpu);
 
-        // create the subsystems (display, input, audio)
-        try {
-            display = new CDisplay(vic, "vc64-emu", fullScreen);
-        } catch (std::exception ex) {
-            SDL_LogError(SDL_LOG_CATEGORY_ERROR, "display->init(): %s",
-                         ex.what());
-            break;
+        if (path && CSIDPlayer::isSIDFile(path)) {
+            // playing a tune, no video at all
+            sidPlayer = new CSIDPlayer();
+            if (sidPlayer->load(path, sidSong) != 0) {
+                break;
+            }
+            vic->setRenderingEnabled(false);
+        }
+        vic->setFrameSkip(frameSkip, frameSkipEvery);
+
+        // create the subsystems (display, input, audio). headless, the
+        // display is offscreen when capturing
+        if ((!headless || capturePath) && !sidPlayer) {
+            CVICII *renderer = vic;
+            if (useRenderThread) {
+                // the display is drawn by the render thread's vic
+                renderThread = new CRenderThread(vicModel, cpu, cia2, pla);
+                renderer = renderThread->renderer();
+            }
+            try {
+                display = new CDisplay(renderer,
+                                       headless ? nullptr : "vc64-emu",
+                                       fullScreen, asyncPresent, zeroCopy,
+                                       scaler);
+            } catch (std::exception ex) {
+                SDL_LogError(SDL_LOG_CATEGORY_ERROR, "display->init(): %s",
+                             ex.what());
+                break;
+            }
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "display initialized OK!");
+            if (display->isZeroCopy()) {
+                // the locked texture doesn't keep the previous frame
+                vic->setKeepUnchangedLines(false);
+            }
+            if (renderThread) {
+                if (renderThread->start() != 0) {
+                    break;
+                }
+                vic->setRenderThread(renderThread);
+            }
+            if (capturePath) {
+                capture =
+                    new CCapture(VIC_SCREEN_W, VIC_SCREEN_H, vic->clockHz(),
+                                 vic->cyclesPerFrame(), scaler);
+                if (capture->open(capturePath) != 0) {
+                    break;
+                }
+                display->setCapture(capture);
+            }
         }
         input = new CInput(cia1, joyNum);
-        audio = new CAudio(sid);
-        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "display initialized OK!");
+        if (scriptPath) {
+            if (input->loadScript(scriptPath) != 0) {
+                break;
+            }
+        }
+        if (moviePath) {
+            movie = new CMovie(cia1);
+            res = moviePlayback ? movie->play(moviePath)
+                                : movie->record(moviePath);
+            if (res != 0) {
+                break;
+            }
+            input->setMovie(movie);
+        }
+        audio = new CAudio(sid, vic->clockHz(), audioQuality, !headless);
+        if (audioPath) {
+            if (audio->openFile(audioPath) != 0) {
+                break;
+            }
+        }
 
-        int timeNow = SDL_GetTicks();
         if (isTestCpu) {
             // running test
             SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION,
@@ -353,72 +967,42 @@ int main(int argc, char **argv) {
             vic->setCollisionHandling(enableSprSpr, enableSprBck);
         }
 
-        // 312 lines * 63 Cycles = 19656
-        int cyclesPerFrame = 19656;
-        int msecPerFrame = 20; // (50 : 1 = 1: x) * 1000
-        int cycleCounter = cyclesPerFrame;
-        while (running) {
-            // step the cpu
-            int cycles = cpu->step(debugger, debugger ? hotkeyDbgBreak : false);
-            if (cycles == -1) {
-                // exit loop
-                running = false;
-                continue;
+        if (asyncPresent && display && !headless) {
+            // the window and the renderer stay on this thread, which pumps
+            // the events and presents the frames handed over by the
+            // emulation thread
+            pumpOnMainThread = true;
+            SDL_Thread *emulation =
+                SDL_CreateThread(emulationProc, "emulation", nullptr);
+            if (!emulation) {
+                SDL_LogError(SDL_LOG_CATEGORY_ERROR, "SDL_CreateThread(): %s",
+                             SDL_GetError());
+                break;
             }
-            totalCycles += cycles;
-
-            // reset hotkey-dbgbreak status if any (for the debugger)
-            hotkeyDbgBreak = false;
-
-            // update i/o chips
-            cia1->update(totalCycles);
-            cia2->update(totalCycles);
-
-            // updating vic takes into account the less scanlines for
-            // badlines (23 vs 63)
-            int c = vic->update(totalCycles);
-            cycles += c;
-
-            // @fixme: this is wrong, cycles should be added .... but doing
-            // it screws all (probably vic cycle counting is wrong)
-            // totalCycles += c;
-
-            // update audio chip
-            sid->update(totalCycles);
-
-            // update cyclecounter
-            cycleCounter -= cycles;
-            if (cycleCounter <= 0) {
-                // draw a frame
-                frames++;
-                display->update();
-                // SDL_Log("totalCycles=%lld, frames=%lld", totalCycles,
-                // frames);
-                cycleCounter += cyclesPerFrame;
-
-                // poll events
-                pollSdlEvents();
-
-                // sleep for the remaining time, if any
-                int timeThen = SDL_GetTicks();
-                int diff = timeThen - timeNow;
-                if (diff < msecPerFrame) {
-                    SDL_Delay(msecPerFrame - diff);
+            while (running) {
+                SDL_PumpEvents();
+                if (pasteRequested.exchange(false)) {
+                    SDL_free(pastedText.exchange(SDL_GetClipboardText()));
                 }
-                timeNow = timeThen;
-
-                // handle clipboard, if any
-                input->checkClipboard(totalCycles, cyclesPerFrame, 5);
+                display->present();
+                SDL_Delay(1);
             }
+            SDL_WaitThread(emulation, nullptr);
+            SDL_free(pastedText.exchange(nullptr));
+        } else {
+            emulationLoop();
+        }
 
-            // once the cpu has reached enough cycles to have loaded the
-            // BASIC interpreter, issue a load of our prg. this trigger only
-            // once!
-            if (totalCycles > 2570000 && path) {
-                // if (frames > 1150 && path) {
-                handlePrgLoading();
-                path = nullptr;
-            }
+        // flush the last partial frame of audio
+        audio->update();
+        if (watchpoints) {
+            watchpoints->dump(TRACE_PATH);
+        }
+        if (heatmap) {
+            heatmap->finish();
+        }
+        if (profiler) {
+            profiler->report(profilerTopN);
         }
     } while (0);
 
@@ -430,13 +1014,23 @@ int main(int argc, char **argv) {
            totalCycles, frames);
 
     // done
+    SAFE_DELETE(renderThread)
     SAFE_DELETE(cia1)
     SAFE_DELETE(cia2)
     SAFE_DELETE(vic)
     SAFE_DELETE(sid)
+    SAFE_DELETE(sidPlayer)
     SAFE_DELETE(display)
+    SAFE_DELETE(capture)
     SAFE_DELETE(input)
+    SAFE_DELETE(movie)
+    SAFE_DELETE(kernalTrap)
+    SAFE_DELETE(bootSnapshot)
+    SAFE_DELETE(watchpoints)
+    SAFE_DELETE(heatmap)
+    SAFE_DELETE(profiler)
     SAFE_DELETE(audio)
+    SAFE_DELETE(scaler)
     SAFE_DELETE(mem)
     SAFE_DELETE(cpu)
     if (sdlInitialized) {